@@ -0,0 +1,280 @@
+#include <glib.h>
+#include <glib-object.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "gitg-lanes.h"
+#include "gitg-revision.h"
+
+/* Lays out recorded or generated histories with GitgLanes and reports the
+   time and number of allocations per commit, and the peak RSS. Recorded
+   logs are either in the format of the repository loader or
+   git log --pretty=format:%H%x01%P */
+
+static gchar *synthetic = NULL;
+static gint count = 100000;
+static gint max_lanes = 0;
+static gint jumps = 0;
+
+static GOptionEntry entries[] =
+{
+	{ "synthetic", 's', 0, G_OPTION_ARG_STRING, &synthetic, "Generate a history (linear, many-branch, wide-merge, octopus)", "KIND" },
+	{ "count", 'n', 0, G_OPTION_ARG_INT, &count, "Number of generated commits", "N" },
+	{ "max-lanes", 'm', 0, G_OPTION_ARG_INT, &max_lanes, "Lane budget, 0 for none", "N" },
+	{ "jumps", 'j', 0, G_OPTION_ARG_INT, &jumps, "Number of random rows to lay out again afterwards", "N" },
+	{ NULL }
+};
+
+static gulong num_allocations = 0;
+
+static gpointer
+counting_malloc(gsize size)
+{
+	++num_allocations;
+	return malloc(size);
+}
+
+static gpointer
+counting_realloc(gpointer mem, gsize size)
+{
+	++num_allocations;
+	return realloc(mem, size);
+}
+
+static gpointer
+counting_calloc(gsize num, gsize size)
+{
+	++num_allocations;
+	return calloc(num, size);
+}
+
+static GMemVTable counting_vtable = {
+	counting_malloc,
+	counting_realloc,
+	free,
+	counting_calloc,
+	counting_malloc,
+	counting_realloc
+};
+
+static gchar *
+make_sha(guint id)
+{
+	return g_strdup_printf("%040x", id);
+}
+
+static void
+append_parent(GString *parents, guint id, guint num)
+{
+	if (id >= num)
+		return;
+
+	gchar *sha = make_sha(id);
+
+	if (parents->len)
+		g_string_append_c(parents, ' ');
+
+	g_string_append(parents, sha);
+	g_free(sha);
+}
+
+static void
+synthetic_parents(gchar const *kind, guint i, guint num, GString *parents)
+{
+	guint k;
+
+	if (strcmp(kind, "linear") == 0)
+	{
+		append_parent(parents, i + 1, num);
+	}
+	else if (strcmp(kind, "many-branch") == 0)
+	{
+		/* 32 branches progressing in parallel */
+		append_parent(parents, i + 32, num);
+	}
+	else if (strcmp(kind, "wide-merge") == 0)
+	{
+		/* a mainline merging from long lived topic branches */
+		if (i % 4 == 0)
+		{
+			append_parent(parents, i + 4, num);
+			append_parent(parents, i + 1, num);
+		}
+		else
+		{
+			append_parent(parents, i + 40, num);
+		}
+	}
+	else if (strcmp(kind, "octopus") == 0)
+	{
+		/* every 16 commits an octopus merge of 8 parents */
+		if (i % 16 == 0)
+		{
+			for (k = 1; k <= 8; ++k)
+				append_parent(parents, i + k, num);
+		}
+		else if (i % 16 < 8)
+		{
+			append_parent(parents, i - i % 16 + 16, num);
+		}
+		else
+		{
+			append_parent(parents, i + 1, num);
+		}
+	}
+}
+
+static GPtrArray *
+generate(gchar const *kind, guint num)
+{
+	GPtrArray *revisions = g_ptr_array_sized_new(num);
+	GString *parents = g_string_new("");
+	guint i;
+
+	if (strcmp(kind, "linear") != 0 && strcmp(kind, "many-branch") != 0 &&
+	    strcmp(kind, "wide-merge") != 0 && strcmp(kind, "octopus") != 0)
+	{
+		g_printerr("Unknown history kind: %s\n", kind);
+		exit(1);
+	}
+
+	for (i = 0; i < num; ++i)
+	{
+		gchar *sha = make_sha(i);
+
+		g_string_truncate(parents, 0);
+		synthetic_parents(kind, i, num, parents);
+
+		g_ptr_array_add(revisions, gitg_revision_new(sha, "", "", parents->str, 0));
+		g_free(sha);
+	}
+
+	g_string_free(parents, TRUE);
+	return revisions;
+}
+
+static GPtrArray *
+load(gchar const *filename)
+{
+	gchar *contents;
+	GError *error = NULL;
+
+	if (!g_file_get_contents(filename, &contents, NULL, &error))
+	{
+		g_printerr("Could not read %s: %s\n", filename, error->message);
+		g_error_free(error);
+		exit(1);
+	}
+
+	GPtrArray *revisions = g_ptr_array_new();
+	gchar **lines = g_strsplit(contents, "\n", 0);
+	gchar **line;
+
+	for (line = lines; *line; ++line)
+	{
+		gchar **components = g_strsplit(*line, "\01", 0);
+		guint len = g_strv_length(components);
+
+		/* loader format: hash, author, subject, parents, timestamp */
+		if (len >= 5)
+			g_ptr_array_add(revisions, gitg_revision_new(components[0], components[1], components[2], components[3], 0));
+		else if (len >= 1 && strlen(components[0]) == 40)
+			g_ptr_array_add(revisions, gitg_revision_new(components[0], "", "", len > 1 ? components[1] : "", 0));
+
+		g_strfreev(components);
+	}
+
+	g_strfreev(lines);
+	g_free(contents);
+
+	return revisions;
+}
+
+static glong
+peak_rss()
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	return usage.ru_maxrss;
+}
+
+static void
+report(gchar const *what, guint num, gdouble elapsed, gulong allocations)
+{
+	g_print("%s: %u commits, %.1f ns/commit, %.2f allocations/commit\n",
+	        what,
+	        num,
+	        num ? elapsed * 1e9 / num : 0.0,
+	        num ? (gdouble)allocations / num : 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+	/* count allocations, this needs to be done before anything allocates */
+	g_mem_set_vtable(&counting_vtable);
+	setenv("G_SLICE", "always-malloc", 1);
+
+	g_type_init();
+
+	GError *error = NULL;
+	GOptionContext *context = g_option_context_new("[LOGFILE] - lane layout benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+
+	if (!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("option parsing failed: %s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	g_option_context_free(context);
+
+	if (!synthetic && argc < 2)
+	{
+		g_printerr("Specify a log file or --synthetic\n");
+		return 1;
+	}
+
+	GPtrArray *revisions = synthetic ? generate(synthetic, count) : load(argv[1]);
+	GitgRevision **storage = (GitgRevision **)revisions->pdata;
+	guint num = revisions->len;
+	GitgLanes *lanes = GITG_LANES(g_object_new(GITG_TYPE_LANES, "max-lanes", max_lanes, NULL));
+	GTimer *timer = g_timer_new();
+	gulong allocations = num_allocations;
+	guint i;
+
+	for (i = 0; i < num; ++i)
+		gitg_lanes_ensure(lanes, storage, num, i);
+
+	report("layout", num, g_timer_elapsed(timer, NULL), num_allocations - allocations);
+
+	if (jumps > 0 && num > 0)
+	{
+		GRand *rand = g_rand_new_with_seed(0);
+
+		g_timer_start(timer);
+		allocations = num_allocations;
+
+		for (i = 0; i < jumps; ++i)
+			gitg_lanes_ensure(lanes, storage, num, g_rand_int_range(rand, 0, num));
+
+		report("jumps", jumps, g_timer_elapsed(timer, NULL), num_allocations - allocations);
+		g_rand_free(rand);
+	}
+
+	g_print("peak RSS: %ld kB\n", peak_rss());
+
+	g_timer_destroy(timer);
+	g_object_unref(lanes);
+
+	g_ptr_array_foreach(revisions, (GFunc)gitg_revision_unref, NULL);
+	g_ptr_array_free(revisions, TRUE);
+
+	return 0;
+}
@@ -1,4 +1,5 @@
 #include <math.h>
+#include <string.h>
 #include "gitg-cell-renderer-path.h"
 #include "gitg-lane.h"
 #include "gitg-utils.h"
@@ -11,6 +12,8 @@
 
 #define DEFAULT_LANE_WIDTH (DEFAULT_DOT_WIDTH + 6)
 
+#define PATTERN_CACHE_SIZE 256
+
 /* Properties */
 enum
 {
@@ -29,11 +32,29 @@ struct _GitgCellRendererPathPrivate
 	GitgRevision *revision;
 	GitgRevision *next_revision;
 	GSList *labels;
+	GArray *segments;
+	
+	/* revisions and labels are borrowed when set with set_row */
+	gboolean borrowed;
+	gboolean highlight;
+	
+	/* rendered paths of recently drawn cells, keyed by their geometry */
+	GByteArray *pattern_key;
+	GQueue *pattern_cache;
+	GHashTable *pattern_index;
+	
 	guint lane_width;
 	guint triangle_width;
 	guint dot_width;
 };
 
+typedef struct
+{
+	guint8 *key;
+	guint length;
+	cairo_surface_t *surface;
+} PatternCacheEntry;
+
 static GtkCellRendererTextClass *parent_class = NULL;
 
 G_DEFINE_TYPE(GitgCellRendererPath, gitg_cell_renderer_path, GTK_TYPE_CELL_RENDERER_TEXT)
@@ -41,27 +62,77 @@ G_DEFINE_TYPE(GitgCellRendererPath, gitg_cell_renderer_path, GTK_TYPE_CELL_RENDE
 static gint
 num_lanes(GitgCellRendererPath *self)
 {
-	return g_slist_length (gitg_revision_get_lanes(self->priv->revision));
+	return gitg_lane_row_length(gitg_revision_get_lanes(self->priv->revision));
 }
 
 inline static gint
 total_width(GitgCellRendererPath *self, GtkWidget *widget)
 {
-	PangoFontDescription *font;
-	g_object_get(self, "font-desc", &font, NULL);
+	/* use the font of the text renderer directly, font-desc returns a copy */
+	PangoFontDescription *font = GTK_CELL_RENDERER_TEXT(self)->font;
 		
 	return num_lanes(self) * self->priv->lane_width + gitg_label_renderer_width(widget, font, self->priv->labels);
 }
 
+static guint
+pattern_hash(gconstpointer v)
+{
+	PatternCacheEntry const *entry = (PatternCacheEntry const *)v;
+	guint hash = 5381;
+	guint i;
+	
+	for (i = 0; i < entry->length; ++i)
+		hash = hash * 33 + entry->key[i];
+	
+	return hash;
+}
+
+static gboolean
+pattern_equal(gconstpointer a, gconstpointer b)
+{
+	PatternCacheEntry const *ea = (PatternCacheEntry const *)a;
+	PatternCacheEntry const *eb = (PatternCacheEntry const *)b;
+	
+	return ea->length == eb->length && memcmp(ea->key, eb->key, ea->length) == 0;
+}
+
+static void
+free_pattern_cache_entry(PatternCacheEntry *entry)
+{
+	g_free(entry->key);
+	cairo_surface_destroy(entry->surface);
+	g_slice_free(PatternCacheEntry, entry);
+}
+
+static void
+release_row(GitgCellRendererPath *self)
+{
+	if (!self->priv->borrowed)
+	{
+		gitg_revision_unref(self->priv->revision);
+		gitg_revision_unref(self->priv->next_revision);
+		g_slist_free(self->priv->labels);
+	}
+	
+	self->priv->revision = NULL;
+	self->priv->next_revision = NULL;
+	self->priv->labels = NULL;
+	self->priv->borrowed = FALSE;
+	self->priv->highlight = FALSE;
+}
+
 static void
 gitg_cell_renderer_path_finalize(GObject *object)
 {
 	GitgCellRendererPath *self = GITG_CELL_RENDERER_PATH(object);
 	
-	gitg_revision_unref(self->priv->revision);
-	gitg_revision_unref(self->priv->next_revision);
+	release_row(self);
+	g_array_free(self->priv->segments, TRUE);
 	
-	g_slist_free(self->priv->labels);
+	g_byte_array_free(self->priv->pattern_key, TRUE);
+	g_hash_table_destroy(self->priv->pattern_index);
+	g_queue_foreach(self->priv->pattern_cache, (GFunc)free_pattern_cache_entry, NULL);
+	g_queue_free(self->priv->pattern_cache);
 
 	G_OBJECT_CLASS(gitg_cell_renderer_path_parent_class)->finalize(object);
 }
@@ -84,8 +155,26 @@ renderer_get_size(GtkCellRenderer *renderer, GtkWidget *widget, GdkRectangle *ar
 		*height = area ? area->height : 1;
 }
 
+/* path segments of a cell, grouped by color when stroking */
+typedef enum
+{
+	SEGMENT_EDGE,
+	SEGMENT_ARROW_START,
+	SEGMENT_ARROW_END
+} SegmentType;
+
+typedef struct
+{
+	gint8 color;
+	gboolean dashed;
+	SegmentType type;
+	gint8 from;
+	gint8 to;
+	gint8 yoffset;
+} Segment;
+
 static void
-draw_arrow(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area, gint8 laneidx, gboolean top)
+arrow_path(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area, gint8 laneidx, gboolean top)
 {
 	gdouble cw = self->priv->lane_width;
 	gdouble xpos = area->x + laneidx * cw + cw / 2.0;
@@ -96,104 +185,241 @@ draw_arrow(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area, gint8 la
 	cairo_move_to(cr, xpos - q, ypos + (top ? q : -q));
 	cairo_line_to(cr, xpos, ypos);
 	cairo_line_to(cr, xpos + q, ypos + (top ? q : -q));
-	cairo_stroke(cr);
 	
 	cairo_move_to(cr, xpos, ypos);
 	cairo_line_to(cr, xpos, ypos - df);
-	cairo_stroke(cr);
+}
+
+static void
+edge_path(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area, Segment *segment)
+{
+	gdouble cw = self->priv->lane_width;
+	gdouble ch = area->height / 2.0;
+	gdouble xfrom = area->x + segment->from * cw + cw / 2.0;
+	gdouble xto = area->x + segment->to * cw + cw / 2.0;
+	
+	cairo_move_to(cr, xfrom, area->y + segment->yoffset * ch);
 	
-	//cairo_move_to(cr, xpos, ypos);
-	//cairo_line_to(cr, xpos, ypos + (top ? 1 : -1) * area->height / 2.0);
-	//cairo_stroke(cr);
+	/* passthroughs are straight */
+	if (segment->from == segment->to)
+		cairo_line_to(cr, xto, area->y + (segment->yoffset + 2) * ch);
+	else
+		cairo_curve_to(cr, xfrom, area->y + (segment->yoffset + 1) * ch,
+					   xto, area->y + (segment->yoffset + 1) * ch,
+					   xto, area->y + (segment->yoffset + 2) * ch);
 }
 
 static void
-draw_paths_real(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area, GitgRevision *revision, gdouble yoffset)
+add_edges(GitgCellRendererPath *self, GitgRevision *revision, gint8 yoffset)
 {
 	if (!revision)
 		return;
 
-	GSList *lanes = gitg_revision_get_lanes(revision);
-	gint8 to = 0;
-	gdouble cw = self->priv->lane_width;
-	gdouble ch = area->height / 2.0;
-	GitgLane *lane;
+	guint8 const *row = gitg_revision_get_lanes(revision);
+	GitgLaneArena *arena = gitg_revision_get_lane_arena(revision);
+	guint8 const *ptr = gitg_lane_row_first(row);
+	guint num = gitg_lane_row_length(row);
+	gint8 to;
+	GitgLane lane;
 	
-	while (lanes)
+	for (to = 0; to < num; ++to)
 	{
-		GSList *item;
+		guint i;
 
-		lane = (GitgLane *)(lanes->data);
-		gitg_color_set_cairo_source(lane->color, cr);
+		ptr = gitg_lane_unpack(ptr, &lane);
 		
-		for (item = lane->from; item; item = item->next)
+		for (i = 0; i < lane.num_from; ++i)
 		{
-			gint8 from = (gint8)GPOINTER_TO_INT(item->data);
-			
-			cairo_move_to(cr, area->x + from * cw + cw / 2.0, area->y + yoffset * ch);
-			cairo_curve_to(cr, area->x + from * cw + cw / 2.0, area->y + (yoffset + 1) * ch,
-						   area->x + to * cw + cw / 2.0, area->y + (yoffset + 1) * ch,
-						   area->x + to * cw + cw / 2.0, area->y + (yoffset + 2) * ch);
-			
-			cairo_stroke(cr);
+			Segment segment = {gitg_lane_arena_get_color(arena, lane.color), 
+			                   (lane.type & GITG_LANE_TYPE_OVERFLOW) != 0,
+			                   SEGMENT_EDGE,
+			                   lane.from[i],
+			                   to,
+			                   yoffset};
+
+			g_array_append_val(self->priv->segments, segment);
 		}
-
-		++to;
-		lanes = lanes->next;
 	}
 }
 
 static void
-draw_top_paths(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area)
+add_arrows(GitgCellRendererPath *self)
 {
-	draw_paths_real(self, cr, area, self->priv->revision, -1);
+	guint8 const *row = gitg_revision_get_lanes(self->priv->revision);
+	GitgLaneArena *arena = gitg_revision_get_lane_arena(self->priv->revision);
+	guint8 const *ptr = gitg_lane_row_first(row);
+	guint num = gitg_lane_row_length(row);
+	gint8 to;
+	
+	for (to = 0; to < num; ++to)
+	{
+		GitgLane lane;
+
+		ptr = gitg_lane_unpack(ptr, &lane);
+		
+		if (!GITG_IS_LANE_BOUNDARY(&lane))
+			continue;
+
+		Segment segment = {gitg_lane_arena_get_color(arena, lane.color),
+		                   FALSE,
+		                   lane.type & GITG_LANE_TYPE_START ? SEGMENT_ARROW_START : SEGMENT_ARROW_END,
+		                   to,
+		                   to,
+		                   0};
+
+		g_array_append_val(self->priv->segments, segment);
+	}
 }
 
-static void
-draw_bottom_paths(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area)
+static gint
+compare_segments(Segment const *a, Segment const *b)
 {
-	draw_paths_real(self, cr, area, self->priv->next_revision, 1);
+	if (a->color != b->color)
+		return a->color < b->color ? -1 : 1;
+	
+	return a->dashed - b->dashed;
 }
 
 static void
-draw_arrows(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area)
+stroke_segments(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area)
 {
-	GSList *item;
-	gint8 to = 0;
+	GArray *segments = self->priv->segments;
+	gdouble dashes[] = {3.0};
+	guint i;
+
+	cairo_set_line_width(cr, 2);
+	cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
 	
-	for (item = gitg_revision_get_lanes(self->priv->revision); item; item = item->next)
+	/* build one path per color and stroke it once, lanes folded in the
+	   overflow lane are dashed */
+	for (i = 0; i < segments->len; ++i)
 	{
-		GitgLane *lane = (GitgLane *)item->data;
-		gitg_color_set_cairo_source(lane->color, cr);
+		Segment *segment = &g_array_index(segments, Segment, i);
+		
+		if (segment->type == SEGMENT_EDGE)
+			edge_path(self, cr, area, segment);
+		else
+			arrow_path(self, cr, area, segment->to, segment->type == SEGMENT_ARROW_START);
 		
-		if (lane->type & GITG_LANE_TYPE_START)
-			draw_arrow(self, cr, area, to, TRUE);
-		else if (lane->type & GITG_LANE_TYPE_END)
-			draw_arrow(self, cr, area, to, FALSE);
+		if (i + 1 < segments->len && compare_segments(segment, segment + 1) == 0)
+			continue;
 		
-		++to;
+		gitg_color_set_cairo_source(segment->color, cr);
+		cairo_set_dash(cr, dashes, segment->dashed ? 1 : 0, 0);
+		cairo_stroke(cr);
 	}
+	
+	cairo_set_dash(cr, NULL, 0, 0);
+}
+
+static gint
+build_pattern_key(GitgCellRendererPath *self, gint height)
+{
+	GByteArray *key = self->priv->pattern_key;
+	GArray *segments = self->priv->segments;
+	gint8 maxlane = -1;
+	guint i;
+	
+	guint32 header[] = {self->priv->lane_width, height};
+	
+	g_byte_array_set_size(key, 0);
+	g_byte_array_append(key, (guint8 const *)header, sizeof(header));
+	
+	for (i = 0; i < segments->len; ++i)
+	{
+		Segment *segment = &g_array_index(segments, Segment, i);
+		guint8 bytes[] = {segment->color, segment->dashed, segment->type, segment->from, segment->to, segment->yoffset};
+
+		g_byte_array_append(key, bytes, sizeof(bytes));
+		maxlane = MAX(maxlane, MAX(segment->from, segment->to));
+	}
+	
+	/* width of the pattern */
+	return (maxlane + 1) * self->priv->lane_width;
+}
+
+static cairo_surface_t *
+lookup_pattern(GitgCellRendererPath *self, cairo_t *cr, gint width, gint height)
+{
+	PatternCacheEntry lookup = {self->priv->pattern_key->data, self->priv->pattern_key->len, NULL};
+	GList *link = (GList *)g_hash_table_lookup(self->priv->pattern_index, &lookup);
+	PatternCacheEntry *entry;
+	
+	if (link)
+	{
+		if (link != self->priv->pattern_cache->head)
+		{
+			g_queue_unlink(self->priv->pattern_cache, link);
+			g_queue_push_head_link(self->priv->pattern_cache, link);
+		}
+		
+		return ((PatternCacheEntry *)link->data)->surface;
+	}
+	
+	if (self->priv->pattern_cache->length >= PATTERN_CACHE_SIZE)
+	{
+		/* reuse the least recently used entry */
+		link = g_queue_pop_tail_link(self->priv->pattern_cache);
+		entry = (PatternCacheEntry *)link->data;
+		
+		g_hash_table_remove(self->priv->pattern_index, entry);
+		g_free(entry->key);
+		cairo_surface_destroy(entry->surface);
+	}
+	else
+	{
+		entry = g_slice_new(PatternCacheEntry);
+		link = g_list_alloc();
+		link->data = entry;
+	}
+	
+	entry->key = g_memdup(lookup.key, lookup.length);
+	entry->length = lookup.length;
+	entry->surface = cairo_surface_create_similar(cairo_get_target(cr), CAIRO_CONTENT_COLOR_ALPHA, width, height);
+	
+	GdkRectangle area = {0, 0, width, height};
+	cairo_t *context = cairo_create(entry->surface);
+
+	stroke_segments(self, context, &area);
+	cairo_destroy(context);
+	
+	g_queue_push_head_link(self->priv->pattern_cache, link);
+	g_hash_table_insert(self->priv->pattern_index, entry, link);
+	
+	return entry->surface;
 }
 
 static void
 draw_paths(GitgCellRendererPath *self, cairo_t *cr, GdkRectangle *area)
 {
-	cairo_set_line_width(cr, 2);
-	//cairo_set_source_rgb(cr, 0.45, 0.6, 0.74);
-	cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+	GArray *segments = self->priv->segments;
+	
+	g_array_set_size(segments, 0);
 
-	draw_top_paths(self, cr, area);
-	draw_bottom_paths(self, cr, area);
-	draw_arrows(self, cr, area);
+	add_edges(self, self->priv->revision, -1);
+	add_edges(self, self->priv->next_revision, 1);
+	add_arrows(self);
+	
+	if (segments->len == 0)
+		return;
+	
+	g_array_sort(segments, (GCompareFunc)compare_segments);
+	
+	/* most rows repeat the lanes of the row above, so rendered cells are
+	   cached and painted again */
+	gint width = build_pattern_key(self, area->height);
+	cairo_surface_t *surface = lookup_pattern(self, cr, width, area->height);
+
+	cairo_set_source_surface(cr, surface, area->x, area->y);
+	cairo_rectangle(cr, area->x, area->y, width, area->height);
+	cairo_fill(cr);
 }
 
 static void
 draw_labels(GitgCellRendererPath *self, GtkWidget *widget, cairo_t *context, GdkRectangle *area)
 {
 	gint offset = num_lanes(self) * self->priv->lane_width;
-	PangoFontDescription *font;
-	
-	g_object_get(self, "font-desc", &font, NULL);
+	PangoFontDescription *font = GTK_CELL_RENDERER_TEXT(self)->font;
 	
 	cairo_translate(context, offset, 0.0);
 	gitg_label_renderer_draw(widget, font, context, self->priv->labels, area);
@@ -227,7 +453,7 @@ draw_indicator_triangle(GitgCellRendererPath *self, GitgLane *lane, cairo_t *con
 	cairo_set_source_rgb(context, 0, 0, 0);
 	cairo_stroke_preserve(context);
 
-	gitg_color_set_cairo_source(lane->color, context);
+	gitg_color_set_cairo_source(gitg_lane_arena_get_color(gitg_revision_get_lane_arena(self->priv->revision), lane->color), context);
 	cairo_fill(context);
 }
 
@@ -242,7 +468,7 @@ draw_indicator_circle(GitgCellRendererPath *self, GitgLane *lane, cairo_t *conte
 	cairo_set_source_rgb(context, 0, 0, 0);
 	
 	cairo_stroke_preserve(context);
-	gitg_color_set_cairo_source(lane->color, context);
+	gitg_color_set_cairo_source(gitg_lane_arena_get_color(gitg_revision_get_lane_arena(self->priv->revision), lane->color), context);
 	
 	cairo_fill(context);
 }
@@ -250,12 +476,32 @@ draw_indicator_circle(GitgCellRendererPath *self, GitgLane *lane, cairo_t *conte
 static void
 draw_indicator(GitgCellRendererPath *self, cairo_t *context, GdkRectangle *area)
 {
-	GitgLane *lane = gitg_revision_get_lane(self->priv->revision);
+	GitgLane lane;
+	
+	if (!gitg_revision_get_lane(self->priv->revision, &lane))
+		return;
 	
-	if (lane->type & GITG_LANE_SIGN_LEFT || lane->type & GITG_LANE_SIGN_RIGHT)
-		draw_indicator_triangle(self, lane, context, area);
+	if (lane.type & GITG_LANE_SIGN_LEFT || lane.type & GITG_LANE_SIGN_RIGHT)
+		draw_indicator_triangle(self, &lane, context, area);
 	else
-		draw_indicator_circle(self, lane, context, area);
+		draw_indicator_circle(self, &lane, context, area);
+}
+
+static void
+draw_highlight(GitgCellRendererPath *self, GtkWidget *widget, cairo_t *cr, GdkRectangle *area, GtkCellRendererState flags)
+{
+	/* search matches are marked with a tint of the selection color */
+	if (!self->priv->highlight || (flags & GTK_CELL_RENDERER_SELECTED))
+		return;
+	
+	guint offset = total_width(self, widget);
+	
+	cairo_save(cr);
+	cairo_rectangle(cr, area->x + offset, area->y, area->width - offset, area->height);
+	cairo_clip(cr);
+	gdk_cairo_set_source_color(cr, &widget->style->base[GTK_STATE_SELECTED]);
+	cairo_paint_with_alpha(cr, 0.3);
+	cairo_restore(cr);
 }
 
 static void
@@ -268,6 +514,7 @@ renderer_render(GtkCellRenderer *renderer, GdkDrawable *window, GtkWidget *widge
 	cairo_rectangle(cr, area->x, area->y, area->width, area->height);
 	cairo_clip(cr);
 	
+	draw_highlight(self, widget, cr, area, flags);
 	draw_paths(self, cr, area);
 	
 	/* draw indicator */
@@ -320,6 +567,10 @@ gitg_cell_renderer_path_set_property(GObject *object, guint prop_id, const GValu
 {
 	GitgCellRendererPath *self = GITG_CELL_RENDERER_PATH(object);
 	
+	/* setting properties drops a borrowed row */
+	if (self->priv->borrowed)
+		release_row(self);
+	
 	switch (prop_id)
 	{
 		case PROP_REVISION:
@@ -422,6 +673,11 @@ gitg_cell_renderer_path_init(GitgCellRendererPath *self)
 	self->priv->lane_width = DEFAULT_LANE_WIDTH;
 	self->priv->dot_width = DEFAULT_DOT_WIDTH;
 	self->priv->triangle_width = DEFAULT_TRIANGLE_WIDTH;
+	self->priv->segments = g_array_new(FALSE, FALSE, sizeof(Segment));
+	
+	self->priv->pattern_key = g_byte_array_new();
+	self->priv->pattern_cache = g_queue_new();
+	self->priv->pattern_index = g_hash_table_new(pattern_hash, pattern_equal);
 }
 
 GtkCellRenderer *
@@ -429,3 +685,22 @@ gitg_cell_renderer_path_new()
 {
 	return GTK_CELL_RENDERER(g_object_new(GITG_TYPE_CELL_RENDERER_PATH, NULL));
 }
+
+void
+gitg_cell_renderer_path_set_row(GitgCellRendererPath *renderer, GitgRepository *repository, guint row)
+{
+	g_return_if_fail(GITG_IS_CELL_RENDERER_PATH(renderer));
+	
+	/* the revisions and labels are not copied, they only need to stay
+	   valid until the row has been rendered */
+	release_row(renderer);
+	
+	renderer->priv->borrowed = TRUE;
+	renderer->priv->revision = gitg_repository_peek(repository, row);
+	renderer->priv->next_revision = gitg_repository_peek(repository, row + 1);
+	
+	renderer->priv->highlight = gitg_repository_search_is_match(repository, row);
+	
+	if (renderer->priv->revision)
+		renderer->priv->labels = gitg_repository_peek_refs_for_hash(repository, gitg_revision_get_hash(renderer->priv->revision));
+}
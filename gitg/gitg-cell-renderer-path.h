@@ -2,6 +2,7 @@
 #define __GITG_CELL_RENDERER_PATH_H__
 
 #include <gtk/gtkcellrenderertext.h>
+#include "gitg-repository.h"
 
 G_BEGIN_DECLS
 
@@ -30,6 +31,8 @@ struct _GitgCellRendererPathClass {
 GType gitg_cell_renderer_path_get_type (void) G_GNUC_CONST;
 GtkCellRenderer *gitg_cell_renderer_path_new(void);
 
+void gitg_cell_renderer_path_set_row(GitgCellRendererPath *renderer, GitgRepository *repository, guint row);
+
 G_END_DECLS
 
 #endif /* __GITG_CELL_RENDERER_PATH_H__ */
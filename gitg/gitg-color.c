@@ -1,117 +1,51 @@
 #include "gitg-color.h"
-#include <gdk/gdk.h>
 
-static gint8 current_index = 0;
-
-static gchar const *palette[] = {
-	"#c4a000",
-	"#4e9a06",
-	"#ce5c00",
-	"#204a87",
-	"#2e3436",
-	"#6c3566",
-	"#a40000",
-
-	"#8ae234",
-	"#fcaf3e",
-	"#729fcf",
-	"#fce94f",
-	"#888a85",
-	"#ad7fa8",
-	"#e9b96e",
-	"#ef2929"
+/* palette as 0xRRGGBB */
+static guint32 const palette[] = {
+	0xc4a000,
+	0x4e9a06,
+	0xce5c00,
+	0x204a87,
+	0x2e3436,
+	0x6c3566,
+	0xa40000,
+
+	0x8ae234,
+	0xfcaf3e,
+	0x729fcf,
+	0xfce94f,
+	0x888a85,
+	0xad7fa8,
+	0xe9b96e,
+	0xef2929
 };
 
-void
-gitg_color_reset()
-{
-	current_index = 0;
-}
+#define PALETTE_SIZE (sizeof(palette) / sizeof(guint32))
 
 void
-gitg_color_get(GitgColor *color, gdouble *r, gdouble *g, gdouble *b)
+gitg_color_get(gint8 index, gdouble *r, gdouble *g, gdouble *b)
 {
-	gchar const *spec = palette[color->index];
-	GdkColor c;
-	
-	gdk_color_parse(spec, &c);
+	guint32 c = palette[index % PALETTE_SIZE];
 
-	*r = c.red / 65535.0;
-	*g = c.green / 65535.0;
-	*b = c.blue / 65535.0;
+	*r = ((c >> 16) & 0xff) / 255.0;
+	*g = ((c >> 8) & 0xff) / 255.0;
+	*b = (c & 0xff) / 255.0;
 }
 
 void
-gitg_color_set_cairo_source(GitgColor *color, cairo_t *cr)
+gitg_color_set_cairo_source(gint8 index, cairo_t *cr)
 {
 	gdouble r, g, b;
 
-	gitg_color_get(color, &r, &g, &b);
+	gitg_color_get(index, &r, &g, &b);
 	cairo_set_source_rgb(cr, r, g, b);
 }
 
-static gint8
-next_index()
-{
-	gint8 next = current_index++;
-	
-	if (current_index == sizeof(palette) / sizeof(gchar const *))
-		current_index = 0;
-
-	return next;
-}
-
-GitgColor *
-gitg_color_next()
-{
-	GitgColor *res = g_new(GitgColor, 1);
-	res->ref_count = 1;
-	res->index = next_index();
-
-	return res;
-}
-
-GitgColor *
-gitg_color_next_index(GitgColor *color)
-{
-	color->index = next_index();
-	return color;
-}
-
-GitgColor *
-gitg_color_copy(GitgColor *color)
-{
-	GitgColor *copy = g_new(GitgColor, 1);
-	copy->ref_count = 1;
-	copy->index = color->index;
-	
-	return copy;
-}
-
-GitgColor *
-gitg_color_ref(GitgColor *color)
-{
-	if (!color)
-		return NULL;
-
-	++color->ref_count;
-	return color;
-}
-
-GitgColor *
-gitg_color_unref(GitgColor *color)
+gint8
+gitg_color_next_index(gint8 index)
 {
-	if (!color)
-		return NULL;
-	
-	--color->ref_count;
-	
-	if (color->ref_count == 0)
-	{
-		g_free(color);
-		return NULL;
-	}
+	if (++index == PALETTE_SIZE)
+		index = 0;
 
-	return color;
+	return index;
 }
-
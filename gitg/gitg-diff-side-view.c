@@ -0,0 +1,524 @@
+#include <string.h>
+
+#include "gitg-diff-side-view.h"
+#include "gitg-utils.h"
+
+#define GITG_DIFF_SIDE_VIEW_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE((object), GITG_TYPE_DIFF_SIDE_VIEW, GitgDiffSideViewPrivate))
+
+/* rows are laid out again at most this often while a diff is loading */
+#define UPDATE_INTERVAL 250
+#define PADDING 4
+
+/* Properties */
+enum
+{
+	PROP_0,
+
+	PROP_DIFF_VIEW
+};
+
+struct _GitgDiffSideViewPrivate
+{
+	GitgDiffView *view;
+	GtkTextBuffer *buffer;
+
+	/* one entry per row, the text stays in the buffer */
+	GArray *rows;
+	guint rows_serial;
+	guint update_id;
+	gboolean dirty;
+
+	GtkWidget *area;
+	GtkAdjustment *adjustment;
+
+	PangoLayout *layout;
+	gint line_height;
+	gint digit_width;
+};
+
+G_DEFINE_TYPE(GitgDiffSideView, gitg_diff_side_view, GTK_TYPE_HBOX)
+
+static void
+set_buffer(GitgDiffSideView *self, GtkTextBuffer *buffer);
+
+static void
+gitg_diff_side_view_finalize(GObject *object)
+{
+	GitgDiffSideView *self = GITG_DIFF_SIDE_VIEW(object);
+
+	set_buffer(self, NULL);
+
+	if (self->priv->view)
+	{
+		g_signal_handlers_disconnect_matched(self->priv->view, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
+		g_object_unref(self->priv->view);
+	}
+
+	if (self->priv->update_id)
+		g_source_remove(self->priv->update_id);
+
+	if (self->priv->layout)
+		g_object_unref(self->priv->layout);
+
+	g_array_free(self->priv->rows, TRUE);
+
+	G_OBJECT_CLASS(gitg_diff_side_view_parent_class)->finalize(object);
+}
+
+static void
+update_adjustment(GitgDiffSideView *self)
+{
+	GtkAdjustment *adjustment = self->priv->adjustment;
+	gint height = self->priv->area->allocation.height;
+
+	adjustment->upper = (gdouble)self->priv->rows->len * self->priv->line_height;
+	adjustment->page_size = height;
+	adjustment->page_increment = height * 0.9;
+	adjustment->step_increment = self->priv->line_height;
+
+	gtk_adjustment_changed(adjustment);
+
+	if (adjustment->value > MAX(adjustment->upper - adjustment->page_size, 0))
+		gtk_adjustment_set_value(adjustment, MAX(adjustment->upper - adjustment->page_size, 0));
+}
+
+static void
+update_rows(GitgDiffSideView *self)
+{
+	self->priv->dirty = FALSE;
+
+	if (self->priv->view)
+		gitg_diff_view_get_rows(self->priv->view, self->priv->rows, &self->priv->rows_serial);
+	else
+		g_array_set_size(self->priv->rows, 0);
+
+	update_adjustment(self);
+	gtk_widget_queue_draw(self->priv->area);
+}
+
+static gboolean
+on_update_timeout(GitgDiffSideView *self)
+{
+	self->priv->update_id = 0;
+
+	if (GTK_WIDGET_MAPPED(self))
+		update_rows(self);
+
+	return FALSE;
+}
+
+static void
+on_buffer_changed(GtkTextBuffer *buffer, GitgDiffSideView *self)
+{
+	/* hidden views are updated when they are shown */
+	self->priv->dirty = TRUE;
+
+	if (!self->priv->update_id && GTK_WIDGET_MAPPED(self))
+		self->priv->update_id = g_timeout_add(UPDATE_INTERVAL, (GSourceFunc)on_update_timeout, self);
+}
+
+static void
+set_buffer(GitgDiffSideView *self, GtkTextBuffer *buffer)
+{
+	if (self->priv->buffer)
+	{
+		g_signal_handlers_disconnect_by_func(self->priv->buffer, G_CALLBACK(on_buffer_changed), self);
+		g_object_unref(self->priv->buffer);
+	}
+
+	self->priv->buffer = buffer ? g_object_ref(buffer) : NULL;
+
+	if (buffer)
+		g_signal_connect(buffer, "changed", G_CALLBACK(on_buffer_changed), self);
+
+	on_buffer_changed(buffer, self);
+}
+
+static void
+on_view_buffer_set(GitgDiffView *view, GParamSpec *spec, GitgDiffSideView *self)
+{
+	set_buffer(self, gtk_text_view_get_buffer(GTK_TEXT_VIEW(view)));
+}
+
+static void
+set_diff_view(GitgDiffSideView *self, GitgDiffView *view)
+{
+	if (!view)
+		return;
+
+	self->priv->view = g_object_ref(view);
+	g_signal_connect(view, "notify::buffer", G_CALLBACK(on_view_buffer_set), self);
+
+	on_view_buffer_set(view, NULL, self);
+}
+
+static void
+gitg_diff_side_view_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+	GitgDiffSideView *self = GITG_DIFF_SIDE_VIEW(object);
+
+	switch (prop_id)
+	{
+		case PROP_DIFF_VIEW:
+			set_diff_view(self, g_value_get_object(value));
+		break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+gitg_diff_side_view_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GitgDiffSideView *self = GITG_DIFF_SIDE_VIEW(object);
+
+	switch (prop_id)
+	{
+		case PROP_DIFF_VIEW:
+			g_value_set_object(value, self->priv->view);
+		break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+gitg_diff_side_view_map(GtkWidget *widget)
+{
+	GitgDiffSideView *self = GITG_DIFF_SIDE_VIEW(widget);
+
+	GTK_WIDGET_CLASS(gitg_diff_side_view_parent_class)->map(widget);
+
+	if (self->priv->dirty)
+		update_rows(self);
+}
+
+static void
+gitg_diff_side_view_class_init(GitgDiffSideViewClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+
+	object_class->finalize = gitg_diff_side_view_finalize;
+	object_class->set_property = gitg_diff_side_view_set_property;
+	object_class->get_property = gitg_diff_side_view_get_property;
+
+	widget_class->map = gitg_diff_side_view_map;
+
+	g_object_class_install_property(object_class, PROP_DIFF_VIEW,
+					 g_param_spec_object("diff-view",
+							     "DIFF_VIEW",
+							     "The diff view shown side by side",
+							     GITG_TYPE_DIFF_VIEW,
+							     G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+	g_type_class_add_private(object_class, sizeof(GitgDiffSideViewPrivate));
+}
+
+static void
+ensure_layout(GitgDiffSideView *self)
+{
+	if (self->priv->layout)
+		return;
+
+	self->priv->layout = gtk_widget_create_pango_layout(self->priv->area, "0");
+	pango_layout_get_pixel_size(self->priv->layout, &self->priv->digit_width, &self->priv->line_height);
+
+	if (self->priv->line_height <= 0)
+		self->priv->line_height = 1;
+}
+
+static void
+on_area_style_set(GtkWidget *widget, GtkStyle *previous, GitgDiffSideView *self)
+{
+	/* the font might have changed */
+	if (self->priv->layout)
+	{
+		g_object_unref(self->priv->layout);
+		self->priv->layout = NULL;
+	}
+
+	ensure_layout(self);
+	update_adjustment(self);
+}
+
+static void
+on_area_size_allocate(GtkWidget *widget, GtkAllocation *allocation, GitgDiffSideView *self)
+{
+	ensure_layout(self);
+	update_adjustment(self);
+}
+
+/* the colors of the diff view for the rows drawn in their own colors */
+typedef enum
+{
+	COLORS_HEADER,
+	COLORS_HUNK,
+	COLORS_REMOVED,
+	COLORS_ADDED,
+	COLORS_NUM
+} ColorsType;
+
+typedef struct
+{
+	GdkColor *foreground;
+	GdkColor *background;
+} Colors;
+
+static void
+get_colors(GitgDiffSideView *self, Colors *colors)
+{
+	gitg_diff_view_get_row_colors(self->priv->view, GITG_DIFF_VIEW_ROW_HEADER, FALSE, &colors[COLORS_HEADER].foreground, &colors[COLORS_HEADER].background);
+	gitg_diff_view_get_row_colors(self->priv->view, GITG_DIFF_VIEW_ROW_HUNK, FALSE, &colors[COLORS_HUNK].foreground, &colors[COLORS_HUNK].background);
+	gitg_diff_view_get_row_colors(self->priv->view, GITG_DIFF_VIEW_ROW_CHANGE, FALSE, &colors[COLORS_REMOVED].foreground, &colors[COLORS_REMOVED].background);
+	gitg_diff_view_get_row_colors(self->priv->view, GITG_DIFF_VIEW_ROW_CHANGE, TRUE, &colors[COLORS_ADDED].foreground, &colors[COLORS_ADDED].background);
+}
+
+static void
+free_colors(Colors *colors)
+{
+	guint i;
+
+	for (i = 0; i < COLORS_NUM; ++i)
+	{
+		if (colors[i].foreground)
+			gdk_color_free(colors[i].foreground);
+
+		if (colors[i].background)
+			gdk_color_free(colors[i].background);
+	}
+}
+
+static void
+fill(cairo_t *cr, GdkColor *color, gint x, gint y, gint width, gint height)
+{
+	if (!color)
+		return;
+
+	gdk_cairo_set_source_color(cr, color);
+	cairo_rectangle(cr, x, y, width, height);
+	cairo_fill(cr);
+}
+
+/* the text of a buffer line, without the +/- prefix for the lines of hunks */
+static gchar *
+get_line_text(GitgDiffSideView *self, gint line, gboolean prefix)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_iter_at_line(self->priv->buffer, &start, line);
+
+	if (prefix && !gtk_text_iter_ends_line(&start))
+		gtk_text_iter_forward_char(&start);
+
+	end = start;
+
+	if (!gtk_text_iter_ends_line(&end))
+		gtk_text_iter_forward_to_line_end(&end);
+
+	return gtk_text_iter_get_slice(&start, &end);
+}
+
+static void
+draw_text(GitgDiffSideView *self, cairo_t *cr, gchar const *text, GdkColor *color, gint x, gint y, gint width)
+{
+	cairo_save(cr);
+	cairo_rectangle(cr, x, y, width, self->priv->line_height);
+	cairo_clip(cr);
+
+	gdk_cairo_set_source_color(cr, color);
+	pango_layout_set_text(self->priv->layout, text, -1);
+	cairo_move_to(cr, x, y);
+	pango_cairo_show_layout(cr, self->priv->layout);
+
+	cairo_restore(cr);
+}
+
+static void
+draw_number(GitgDiffSideView *self, cairo_t *cr, guint number, GdkColor *color, gint x, gint y, gint width)
+{
+	gchar str[16];
+	gint text_width;
+
+	if (!number)
+		return;
+
+	g_snprintf(str, sizeof(str), "%u", number);
+	pango_layout_set_text(self->priv->layout, str, -1);
+	pango_layout_get_pixel_size(self->priv->layout, &text_width, NULL);
+
+	gdk_cairo_set_source_color(cr, color);
+	cairo_move_to(cr, x + width - text_width, y);
+	pango_cairo_show_layout(cr, self->priv->layout);
+}
+
+static void
+draw_side(GitgDiffSideView *self, cairo_t *cr, GitgDiffViewRow *row, Colors *colors, gboolean new_side, gint x, gint y, gint width, gint number_width)
+{
+	GtkStyle *style = self->priv->area->style;
+	GdkColor *color = &style->text[GTK_STATE_NORMAL];
+	gint line = new_side ? row->new : row->old;
+
+	if (line < 0)
+	{
+		fill(cr, &style->bg[GTK_STATE_NORMAL], x, y, width, self->priv->line_height);
+		return;
+	}
+
+	if (row->type == GITG_DIFF_VIEW_ROW_CHANGE)
+	{
+		Colors *change = &colors[new_side ? COLORS_ADDED : COLORS_REMOVED];
+
+		fill(cr, change->background, x, y, width, self->priv->line_height);
+
+		if (change->foreground)
+			color = change->foreground;
+	}
+
+	guint old;
+	guint new;
+	gitg_diff_view_get_line_numbers(self->priv->view, line, &old, &new);
+	draw_number(self, cr, new_side ? new : old, &style->text_aa[GTK_STATE_NORMAL], x, y, number_width);
+
+	gchar *text = get_line_text(self, line, TRUE);
+	draw_text(self, cr, text, color, x + number_width + PADDING, y, width - number_width - PADDING);
+	g_free(text);
+}
+
+static gboolean
+on_area_expose(GtkWidget *widget, GdkEventExpose *event, GitgDiffSideView *self)
+{
+	if (!self->priv->buffer)
+		return FALSE;
+
+	ensure_layout(self);
+
+	cairo_t *cr = gdk_cairo_create(widget->window);
+	gint line_height = self->priv->line_height;
+	gint width = widget->allocation.width;
+	gint half = width / 2;
+	gdouble value = gtk_adjustment_get_value(self->priv->adjustment);
+	GtkStyle *style = widget->style;
+	Colors colors[COLORS_NUM];
+
+	get_colors(self, colors);
+	gdk_cairo_rectangle(cr, &event->area);
+	cairo_clip(cr);
+
+	gdk_cairo_set_source_color(cr, &style->base[GTK_STATE_NORMAL]);
+	cairo_paint(cr);
+
+	/* room for the largest line number */
+	gchar str[16];
+	g_snprintf(str, sizeof(str), "%d", MAX(gtk_text_buffer_get_line_count(self->priv->buffer), 99));
+	gint number_width = self->priv->digit_width * strlen(str) + PADDING;
+
+	/* only the rows in the exposed area */
+	guint first = (guint)((value + event->area.y) / line_height);
+	guint last = (guint)((value + event->area.y + event->area.height) / line_height);
+	guint i;
+
+	for (i = first; i <= last && i < self->priv->rows->len; ++i)
+	{
+		GitgDiffViewRow *row = &g_array_index(self->priv->rows, GitgDiffViewRow, i);
+		gint y = (gint)(i * (gdouble)line_height - value);
+
+		if (row->type == GITG_DIFF_VIEW_ROW_CONTEXT || row->type == GITG_DIFF_VIEW_ROW_CHANGE)
+		{
+			draw_side(self, cr, row, colors, FALSE, 0, y, half, number_width);
+			draw_side(self, cr, row, colors, TRUE, half, y, width - half, number_width);
+			continue;
+		}
+
+		/* lines outside of hunks span both sides */
+		gchar *text = get_line_text(self, row->old, FALSE);
+		GdkColor *color = &style->text[GTK_STATE_NORMAL];
+		Colors *spanned = NULL;
+
+		if (row->type == GITG_DIFF_VIEW_ROW_HEADER)
+			spanned = &colors[COLORS_HEADER];
+		else if (row->type == GITG_DIFF_VIEW_ROW_HUNK)
+			spanned = &colors[COLORS_HUNK];
+
+		if (spanned)
+		{
+			fill(cr, spanned->background, 0, y, width, line_height);
+
+			if (spanned->foreground)
+				color = spanned->foreground;
+		}
+
+		draw_text(self, cr, text, color, PADDING, y, width - PADDING);
+		g_free(text);
+	}
+
+	/* the old and new sides */
+	gdk_cairo_set_source_color(cr, &style->dark[GTK_STATE_NORMAL]);
+	cairo_rectangle(cr, half, event->area.y, 1, event->area.height);
+	cairo_fill(cr);
+
+	free_colors(colors);
+	cairo_destroy(cr);
+	return TRUE;
+}
+
+static gboolean
+on_area_scroll(GtkWidget *widget, GdkEventScroll *event, GitgDiffSideView *self)
+{
+	GtkAdjustment *adjustment = self->priv->adjustment;
+	gdouble delta = adjustment->step_increment * 3;
+	gdouble value = adjustment->value;
+
+	if (event->direction == GDK_SCROLL_UP)
+		value -= delta;
+	else if (event->direction == GDK_SCROLL_DOWN)
+		value += delta;
+	else
+		return FALSE;
+
+	gtk_adjustment_set_value(adjustment, CLAMP(value, 0, MAX(adjustment->upper - adjustment->page_size, 0)));
+	return TRUE;
+}
+
+static void
+on_adjustment_value_changed(GtkAdjustment *adjustment, GitgDiffSideView *self)
+{
+	gtk_widget_queue_draw(self->priv->area);
+}
+
+static void
+gitg_diff_side_view_init(GitgDiffSideView *self)
+{
+	self->priv = GITG_DIFF_SIDE_VIEW_GET_PRIVATE(self);
+
+	self->priv->rows = g_array_new(FALSE, FALSE, sizeof(GitgDiffViewRow));
+	self->priv->line_height = 1;
+
+	self->priv->area = gtk_drawing_area_new();
+	gitg_utils_set_monospace_font(self->priv->area);
+	gtk_widget_add_events(self->priv->area, GDK_SCROLL_MASK);
+
+	self->priv->adjustment = GTK_ADJUSTMENT(gtk_adjustment_new(0, 0, 0, 1, 1, 1));
+	GtkWidget *scrollbar = gtk_vscrollbar_new(self->priv->adjustment);
+
+	gtk_box_pack_start(GTK_BOX(self), self->priv->area, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(self), scrollbar, FALSE, FALSE, 0);
+
+	gtk_widget_show(self->priv->area);
+	gtk_widget_show(scrollbar);
+
+	g_signal_connect(self->priv->area, "expose-event", G_CALLBACK(on_area_expose), self);
+	g_signal_connect(self->priv->area, "scroll-event", G_CALLBACK(on_area_scroll), self);
+	g_signal_connect(self->priv->area, "style-set", G_CALLBACK(on_area_style_set), self);
+	g_signal_connect(self->priv->area, "size-allocate", G_CALLBACK(on_area_size_allocate), self);
+	g_signal_connect(self->priv->adjustment, "value-changed", G_CALLBACK(on_adjustment_value_changed), self);
+}
+
+GtkWidget *
+gitg_diff_side_view_new(GitgDiffView *view)
+{
+	return GTK_WIDGET(g_object_new(GITG_TYPE_DIFF_SIDE_VIEW, "diff-view", view, NULL));
+}
@@ -0,0 +1,41 @@
+#ifndef __GITG_DIFF_SIDE_VIEW_H__
+#define __GITG_DIFF_SIDE_VIEW_H__
+
+#include <gtk/gtk.h>
+#include "gitg-diff-view.h"
+
+G_BEGIN_DECLS
+
+#define GITG_TYPE_DIFF_SIDE_VIEW			(gitg_diff_side_view_get_type ())
+#define GITG_DIFF_SIDE_VIEW(obj)			(G_TYPE_CHECK_INSTANCE_CAST ((obj), GITG_TYPE_DIFF_SIDE_VIEW, GitgDiffSideView))
+#define GITG_DIFF_SIDE_VIEW_CONST(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), GITG_TYPE_DIFF_SIDE_VIEW, GitgDiffSideView const))
+#define GITG_DIFF_SIDE_VIEW_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST ((klass), GITG_TYPE_DIFF_SIDE_VIEW, GitgDiffSideViewClass))
+#define GITG_IS_DIFF_SIDE_VIEW(obj)			(G_TYPE_CHECK_INSTANCE_TYPE ((obj), GITG_TYPE_DIFF_SIDE_VIEW))
+#define GITG_IS_DIFF_SIDE_VIEW_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE ((klass), GITG_TYPE_DIFF_SIDE_VIEW))
+#define GITG_DIFF_SIDE_VIEW_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS ((obj), GITG_TYPE_DIFF_SIDE_VIEW, GitgDiffSideViewClass))
+
+typedef struct _GitgDiffSideView		GitgDiffSideView;
+typedef struct _GitgDiffSideViewClass	GitgDiffSideViewClass;
+typedef struct _GitgDiffSideViewPrivate	GitgDiffSideViewPrivate;
+
+/* Shows the diff of a GitgDiffView with the old and new lines next to each
+   other. Only the rows in view are drawn, their text is read from the
+   buffer of the diff view */
+struct _GitgDiffSideView
+{
+	GtkHBox parent;
+
+	GitgDiffSideViewPrivate *priv;
+};
+
+struct _GitgDiffSideViewClass
+{
+	GtkHBoxClass parent_class;
+};
+
+GType gitg_diff_side_view_get_type(void) G_GNUC_CONST;
+GtkWidget *gitg_diff_side_view_new(GitgDiffView *view);
+
+G_END_DECLS
+
+#endif /* __GITG_DIFF_SIDE_VIEW_H__ */
@@ -1,4 +1,5 @@
 #include "gitg-diff-view.h"
+#include "gitg-word-diff.h"
 #include <string.h>
 
 #define GITG_DIFF_VIEW_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE((object), GITG_TYPE_DIFF_VIEW, GitgDiffViewPrivate))
@@ -13,17 +14,29 @@
 
 #define IDLE_SCAN_COUNT 30
 
+/* diffs larger than this (in characters) are colored by the built-in
+   tagging only, the syntax highlighting engine is too slow for them */
+#define DEFAULT_MAX_HIGHLIGHT_SIZE (256 * 1024)
+
+/* changes with more lines, and longer lines, are not diffed per word */
+#define MAX_WORD_DIFF_LINES 100
+#define MAX_WORD_DIFF_LINE_LENGTH 1000
+
 static void on_buffer_insert_text(GtkTextBuffer *buffer, GtkTextIter *iter, gchar const *text, gint len, GitgDiffView *view);
 static void on_buffer_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, GitgDiffView *view);
+static void on_buffer_before_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, GitgDiffView *view);
 
 static gboolean on_idle_scan(GitgDiffView *view);
+static void on_word_diff_done(GitgWordDiff *diff, GitgDiffView *view);
+static void on_style_scheme_changed(GtkSourceBuffer *buffer, GParamSpec *spec, GitgDiffView *view);
 
 /* Properties */
 enum
 {
 	PROP_0,
 	
-	PROP_DIFF_ENABLED
+	PROP_DIFF_ENABLED,
+	PROP_MAX_HIGHLIGHT_SIZE
 };
 
 typedef struct _Region Region;
@@ -34,21 +47,62 @@ typedef enum
 	REGION_TYPE_HUNK
 } RegionType;
 
+/* Regions start at a mark on their first line, so they move along with
+   edits of the buffer before them */
 struct _Region
 {
 	RegionType type;
 	Region *next;
 
-	guint line;
+	GtkTextMark *mark;
+	GSequenceIter *iter;
 };
 
+typedef enum
+{
+	LINE_TYPE_CONTEXT,
+	LINE_TYPE_ADDED,
+	LINE_TYPE_REMOVED
+} LineType;
+
+/* A run of lines of the same type in a hunk, starting offset lines after
+   the hunk header, with the number of old and new lines before it */
+typedef struct
+{
+	guint offset;
+	guint old;
+	guint new;
+	LineType type;
+	
+	/* a removed run followed by an added run was sent for word diffing */
+	gboolean word_diff;
+} HunkRun;
+
 typedef struct 
 {
 	Region region;
 	guint old;
 	guint new;
+	
+	GArray *runs;
+	guint num_lines;
+	
+	/* identifies the hunk to word diffing, 0 until it is needed */
+	guint serial;
 } Hunk;
 
+typedef enum
+{
+	TAG_FILE,
+	TAG_LOCATION,
+	TAG_ADDED,
+	TAG_REMOVED,
+	TAG_WORD_ADDED,
+	TAG_WORD_REMOVED,
+	TAG_NUM,
+	TAG_NONE = TAG_NUM
+} TagType;
+
 struct _GitgDiffViewPrivate
 {
 	guint last_scan_line;
@@ -58,9 +112,38 @@ struct _GitgDiffViewPrivate
 	Region *last_region;
 	GSequence *regions_index;
 	
+	/* regions removed by a deletion, or all invalid */
+	Region *deleted_regions;
+	gboolean regions_invalid;
+	
+	/* changes on every edit other than appending text, see get_rows */
+	guint rows_serial;
+	
 	guint scan_id;
 	gboolean diff_enabled;
 	GtkTextBuffer *current_buffer;
+	
+	GtkTextTag *tags[TAG_NUM];
+	
+	/* header state after the last classified line, and before it so that
+	   the line can be classified again when text is added to it */
+	gboolean tag_in_header;
+	gboolean tag_header_before;
+	gint tag_last_line;
+	
+	guint max_highlight_size;
+	gboolean highlight_disabled;
+	
+	/* line number gutter */
+	PangoLayout *gutter_layout;
+	guint gutter_max_line;
+	gint gutter_width;
+	
+	/* word diffs of the visible changes */
+	GitgWordDiff *word_diff;
+	GHashTable *word_diff_hunks;
+	guint word_diff_serial;
+	guint word_diff_id;
 };
 
 G_DEFINE_TYPE(GitgDiffView, gitg_diff_view, GTK_TYPE_SOURCE_VIEW)
@@ -68,28 +151,81 @@ G_DEFINE_TYPE(GitgDiffView, gitg_diff_view, GTK_TYPE_SOURCE_VIEW)
 static gboolean gitg_diff_view_expose(GtkWidget *widget, GdkEventExpose *event);
 
 static void
-region_free(Region *region)
+region_free(GitgDiffView *view, Region *region)
 {
-	if (!region)
+	while (region)
+	{
+		Region *next = region->next;
+		
+		gtk_text_buffer_delete_mark(view->priv->current_buffer, region->mark);
+		
+		if (region->type == REGION_TYPE_HEADER)
+		{
+			g_slice_free(Region, region);
+		}
+		else
+		{
+			Hunk *hunk = (Hunk *)region;
+			
+			if (hunk->serial)
+				g_hash_table_remove(view->priv->word_diff_hunks, GUINT_TO_POINTER(hunk->serial));
+			
+			g_array_free(hunk->runs, TRUE);
+			g_slice_free(Hunk, (Hunk *)region);
+		}
+		
+		region = next;
+	}
+}
+
+static void
+restore_highlight(GitgDiffView *view)
+{
+	if (!view->priv->highlight_disabled)
 		return;
 	
-	region_free(region->next);
+	view->priv->highlight_disabled = FALSE;
 	
-	if (region->type == REGION_TYPE_HEADER)
-		g_slice_free(Region, region);
-	else
-		g_slice_free(Hunk, (Hunk *)region);
+	if (GTK_IS_SOURCE_BUFFER(view->priv->current_buffer))
+		gtk_source_buffer_set_highlight_syntax(GTK_SOURCE_BUFFER(view->priv->current_buffer), TRUE);
+}
+
+static void
+remove_tags(GitgDiffView *view)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	guint i;
+	
+	if (!view->priv->current_buffer)
+		return;
+	
+	gtk_text_buffer_get_bounds(view->priv->current_buffer, &start, &end);
+	
+	for (i = 0; i < TAG_NUM; ++i)
+	{
+		if (view->priv->tags[i])
+			gtk_text_buffer_remove_tag(view->priv->current_buffer, view->priv->tags[i], &start, &end);
+	}
+	
+	view->priv->tag_in_header = FALSE;
+	view->priv->tag_last_line = -1;
 }
 
 static void
 regions_free(GitgDiffView *view, gboolean remove_signals)
 {
-	region_free(view->priv->regions);
+	region_free(view, view->priv->regions);
+	region_free(view, view->priv->deleted_regions);
+	gitg_word_diff_cancel(view->priv->word_diff);
 	g_sequence_remove_range(g_sequence_get_begin_iter(view->priv->regions_index), g_sequence_get_end_iter(view->priv->regions_index));
 	
 	view->priv->regions = NULL;
 	view->priv->last_region = NULL;
+	view->priv->deleted_regions = NULL;
+	view->priv->regions_invalid = FALSE;
 	view->priv->last_scan_line = 0;
+	view->priv->rows_serial++;
 	view->priv->max_line_count = 99;
 
 	if (view->priv->scan_id)
@@ -102,6 +238,11 @@ regions_free(GitgDiffView *view, gboolean remove_signals)
 	{
 		g_signal_handlers_disconnect_by_func(view->priv->current_buffer, G_CALLBACK(on_buffer_insert_text), view);
 		g_signal_handlers_disconnect_by_func(view->priv->current_buffer, G_CALLBACK(on_buffer_delete_range), view);
+		g_signal_handlers_disconnect_by_func(view->priv->current_buffer, G_CALLBACK(on_buffer_before_delete_range), view);
+		g_signal_handlers_disconnect_by_func(view->priv->current_buffer, G_CALLBACK(on_style_scheme_changed), view);
+		
+		restore_highlight(view);
+		remove_tags(view);
 
 		g_object_unref(view->priv->current_buffer);
 		view->priv->current_buffer = NULL;
@@ -114,7 +255,18 @@ gitg_diff_view_finalize(GObject *object)
 	GitgDiffView *view = GITG_DIFF_VIEW(object);
 	
 	regions_free(view, TRUE);
+	
+	gitg_word_diff_free(view->priv->word_diff);
+	view->priv->word_diff = NULL;
+	
+	if (view->priv->word_diff_id)
+		g_source_remove(view->priv->word_diff_id);
+	
 	g_sequence_free(view->priv->regions_index);
+	g_hash_table_destroy(view->priv->word_diff_hunks);
+	
+	if (view->priv->gutter_layout)
+		g_object_unref(view->priv->gutter_layout);
 	
 	G_OBJECT_CLASS(gitg_diff_view_parent_class)->finalize(object);
 }
@@ -122,6 +274,13 @@ gitg_diff_view_finalize(GObject *object)
 static void
 set_diff_enabled(GitgDiffView *view, gboolean enabled)
 {
+	if (!enabled)
+	{
+		restore_highlight(view);
+		remove_tags(view);
+		gitg_word_diff_cancel(view->priv->word_diff);
+	}
+	
 	view->priv->diff_enabled = enabled;
 	gtk_widget_queue_draw(GTK_WIDGET(view));
 }
@@ -136,6 +295,9 @@ gitg_diff_view_set_property(GObject *object, guint prop_id, const GValue *value,
 		case PROP_DIFF_ENABLED:
 			set_diff_enabled(self, g_value_get_boolean(value));
 		break;
+		case PROP_MAX_HIGHLIGHT_SIZE:
+			self->priv->max_highlight_size = g_value_get_uint(value);
+		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -152,6 +314,9 @@ gitg_diff_view_get_property(GObject *object, guint prop_id, GValue *value, GPara
 		case PROP_DIFF_ENABLED:
 			g_value_set_boolean(value, self->priv->diff_enabled);
 		break;
+		case PROP_MAX_HIGHLIGHT_SIZE:
+			g_value_set_uint(value, self->priv->max_highlight_size);
+		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -178,30 +343,116 @@ gitg_diff_view_class_init(GitgDiffViewClass *klass)
 							      FALSE,
 							      G_PARAM_READWRITE));
 
+	g_object_class_install_property(object_class, PROP_MAX_HIGHLIGHT_SIZE,
+					 g_param_spec_uint("max-highlight-size",
+							   "MAX_HIGHLIGHT_SIZE",
+							   "Size above which diffs are not syntax highlighted, 0 for no limit",
+							   0,
+							   G_MAXUINT,
+							   DEFAULT_MAX_HIGHLIGHT_SIZE,
+							   G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
 	g_type_class_add_private(object_class, sizeof(GitgDiffViewPrivate));
 }
 
+static void
+set_tag_style(GtkTextTag *tag, GtkSourceStyleScheme *scheme, gchar const *id, gchar const *foreground, gchar const *background)
+{
+	GtkSourceStyle *style = scheme ? gtk_source_style_scheme_get_style(scheme, id) : NULL;
+	
+	/* colors of the scheme, falling back to those of the gitg scheme */
+	if (style)
+	{
+		gchar *fg = NULL;
+		gchar *bg = NULL;
+		gboolean fg_set;
+		gboolean bg_set;
+		
+		g_object_get(style, "foreground", &fg, "foreground-set", &fg_set, "line-background", &bg, "line-background-set", &bg_set, NULL);
+		g_object_set(tag, "foreground", fg_set ? fg : NULL, "paragraph-background", bg_set ? bg : NULL, NULL);
+		
+		g_free(fg);
+		g_free(bg);
+	}
+	else
+	{
+		g_object_set(tag, "foreground", foreground, "paragraph-background", background, NULL);
+	}
+}
+
+static void
+update_tag_styles(GitgDiffView *view)
+{
+	GtkSourceStyleScheme *scheme = NULL;
+	
+	if (GTK_IS_SOURCE_BUFFER(view->priv->current_buffer))
+		scheme = gtk_source_buffer_get_style_scheme(GTK_SOURCE_BUFFER(view->priv->current_buffer));
+	
+	set_tag_style(view->priv->tags[TAG_FILE], scheme, "diff:diff-file", "#d3d7cf", "#ce5c00");
+	set_tag_style(view->priv->tags[TAG_LOCATION], scheme, "diff:location", "#eeeeec", "#3465a4");
+	set_tag_style(view->priv->tags[TAG_ADDED], scheme, "diff:added-line", "#4e9a06", "#d4ffab");
+	set_tag_style(view->priv->tags[TAG_REMOVED], scheme, "diff:removed-line", "#ef2929", "#ffd8d8");
+	
+	/* changed words stand out from the line background */
+	g_object_set(view->priv->tags[TAG_WORD_ADDED], "background", "#aee77a", NULL);
+	g_object_set(view->priv->tags[TAG_WORD_REMOVED], "background", "#f8a8a8", NULL);
+}
+
+static void
+on_style_scheme_changed(GtkSourceBuffer *buffer, GParamSpec *spec, GitgDiffView *view)
+{
+	update_tag_styles(view);
+}
+
 static void
 on_buffer_set(GitgDiffView *self, GParamSpec *spec, gpointer userdata)
 {
+	guint i;
+	
 	/* remove all regions for a new buffer */
 	regions_free(self, TRUE);
 	
 	self->priv->current_buffer = g_object_ref(gtk_text_view_get_buffer(GTK_TEXT_VIEW(self)));
 	g_signal_connect_after(self->priv->current_buffer, "insert-text", G_CALLBACK(on_buffer_insert_text), self);
 	g_signal_connect_after(self->priv->current_buffer, "delete-range", G_CALLBACK(on_buffer_delete_range), self);
+	g_signal_connect(self->priv->current_buffer, "delete-range", G_CALLBACK(on_buffer_before_delete_range), self);
+	g_signal_connect(self->priv->current_buffer, "notify::style-scheme", G_CALLBACK(on_style_scheme_changed), self);
+	
+	/* created before the tags of the highlighting engine, which therefore
+	   takes precedence where it runs */
+	for (i = 0; i < TAG_NUM; ++i)
+		self->priv->tags[i] = gtk_text_buffer_create_tag(self->priv->current_buffer, NULL, NULL);
+	
+	update_tag_styles(self);
 
 	self->priv->scan_id = g_idle_add((GSourceFunc)on_idle_scan, self);
 }
 
+static void
+on_style_set(GitgDiffView *self, GtkStyle *previous, gpointer userdata)
+{
+	/* the font might have changed */
+	if (self->priv->gutter_layout)
+	{
+		g_object_unref(self->priv->gutter_layout);
+		self->priv->gutter_layout = NULL;
+	}
+}
+
 static void
 gitg_diff_view_init(GitgDiffView *self)
 {
 	self->priv = GITG_DIFF_VIEW_GET_PRIVATE(self);
 	
 	self->priv->regions_index = g_sequence_new(NULL);
+	self->priv->tag_last_line = -1;
+	self->priv->rows_serial = 1;
+	
+	self->priv->word_diff = gitg_word_diff_new((GitgWordDiffFunc)on_word_diff_done, self);
+	self->priv->word_diff_hunks = g_hash_table_new(g_direct_hash, g_direct_equal);
 	
 	g_signal_connect(self, "notify::buffer", G_CALLBACK(on_buffer_set), NULL);
+	g_signal_connect(self, "style-set", G_CALLBACK(on_style_set), NULL);
 }
 
 GitgDiffView*
@@ -279,19 +530,50 @@ get_lines (GtkTextView *text_view, gint first_y, gint last_y, GArray *buffer_coo
 	*countp = count;
 }
 
+static guint
+region_line(GitgDiffView *view, Region *region)
+{
+	GtkTextIter iter;
+	
+	gtk_text_buffer_get_iter_at_mark(view->priv->current_buffer, &iter, region->mark);
+	return gtk_text_iter_get_line(&iter);
+}
+
+typedef struct
+{
+	GitgDiffView *view;
+	guint line;
+} IndexKey;
+
 static gint
 index_compare(gconstpointer a, gconstpointer b, gpointer userdata)
 {
-	guint la = ((Region *)a)->line;
-	guint lb = ((Region *)b)->line;
+	/* the searched for line is passed as a NULL region */
+	IndexKey *key = (IndexKey *)userdata;
+	guint la = a ? region_line(key->view, (Region *)a) : key->line;
+	guint lb = b ? region_line(key->view, (Region *)b) : key->line;
 	
 	return la < lb ? -1 : (la > lb ? 1 : 0);
 }
 
+static void
+region_init(GitgDiffView *view, Region *region, RegionType type, guint line)
+{
+	GtkTextIter iter;
+	
+	gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &iter, line);
+	
+	region->type = type;
+	region->next = NULL;
+	region->mark = gtk_text_buffer_create_mark(view->priv->current_buffer, NULL, &iter, FALSE);
+}
+
 static void
 ensure_max_line(GitgDiffView *view, Hunk *hunk)
 {
-	guint num = hunk->region.next ? hunk->region.next->line - hunk->region.line : 0;
+	guint line = region_line(view, (Region *)hunk);
+	guint end = hunk->region.next ? region_line(view, hunk->region.next) : view->priv->last_scan_line;
+	guint num = end > line ? end - line : 0;
 	guint m = MAX(hunk->new + num, hunk->old + num);
 
 	if (m > view->priv->max_line_count)
@@ -313,31 +595,106 @@ add_region(GitgDiffView *view, Region *region)
 		view->priv->regions = region;
 	}
 
+	/* regions are made in buffer order */
 	view->priv->last_region = region;
-	g_sequence_insert_sorted(view->priv->regions_index, region, index_compare, NULL);
+	region->iter = g_sequence_append(view->priv->regions_index, region);
+}
+
+static void
+parse_hunk_header(Hunk *hunk, gchar const *text, gsize len)
+{
+	gchar const *old = memchr(text, '-', len);
+	gchar const *new = memchr(text, '+', len);
+	
+	hunk->old = old ? atoi(old + 1) : 0;
+	hunk->new = new ? atoi(new + 1) : 0;
 }
 
 static void
-parse_hunk_info(Hunk *hunk, GtkTextIter *iter)
+hunk_add_line(Hunk *hunk, gchar prefix)
 {
-	GtkTextIter end = *iter;
+	LineType type = prefix == '+' ? LINE_TYPE_ADDED : (prefix == '-' ? LINE_TYPE_REMOVED : LINE_TYPE_CONTEXT);
+	HunkRun *last = hunk->runs->len ? &g_array_index(hunk->runs, HunkRun, hunk->runs->len - 1) : NULL;
 	
-	gtk_text_iter_forward_to_line_end(&end);
-	gchar *text = gtk_text_iter_get_text(iter, &end);
+	++hunk->num_lines;
 	
-	hunk->old = 0;
-	hunk->new = 0;
+	if (last && last->type == type)
+		return;
+	
+	HunkRun run = {hunk->num_lines, 0, 0, type};
+	
+	if (last)
+	{
+		guint num = run.offset - last->offset;
+		
+		run.old = last->old + (last->type != LINE_TYPE_ADDED ? num : 0);
+		run.new = last->new + (last->type != LINE_TYPE_REMOVED ? num : 0);
+	}
 	
-	gchar *old = g_utf8_strchr(text, -1, '-');
-	gchar *new = g_utf8_strchr(text, -1, '+');
+	g_array_append_val(hunk->runs, run);
+}
 
-	if (!old || !new)
+/* Old and new line number of a line in a hunk starting at hunk_line, 0 when
+   the line has none */
+static void
+hunk_line_numbers(Hunk *hunk, guint hunk_line, guint line, guint *old, guint *new)
+{
+	guint offset = line - hunk_line;
+	
+	*old = *new = 0;
+	
+	if (offset == 0 || offset > hunk->num_lines)
 		return;
 	
-	hunk->old = atoi(old + 1);
-	hunk->new = atoi(new + 1);
+	/* the last run starting at or before offset */
+	guint lo = 0;
+	guint hi = hunk->runs->len;
+	
+	while (hi - lo > 1)
+	{
+		guint mid = (lo + hi) / 2;
+		
+		if (g_array_index(hunk->runs, HunkRun, mid).offset <= offset)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	
+	HunkRun *run = &g_array_index(hunk->runs, HunkRun, lo);
+	guint num = offset - run->offset;
+	
+	if (run->type != LINE_TYPE_ADDED)
+		*old = hunk->old + run->old + num;
+	
+	if (run->type != LINE_TYPE_REMOVED)
+		*new = hunk->new + run->new + num;
+}
 
-	g_free(text);
+/* makes a region if line starts one, line is the text of buffer line nr */
+static void
+scan_line(GitgDiffView *view, gchar const *line, gsize len, guint nr)
+{
+	if (len >= 3 && strncmp(line, "@@ ", 3) == 0)
+	{
+		Hunk *hunk = g_slice_new(Hunk);
+		region_init(view, (Region *)hunk, REGION_TYPE_HUNK, nr);
+		hunk->runs = g_array_new(FALSE, FALSE, sizeof(HunkRun));
+		hunk->num_lines = 0;
+		parse_hunk_header(hunk, line, len);
+		
+		add_region(view, (Region *)hunk);
+	}
+	else if (len >= 10 && strncmp(line, "diff --git", 10) == 0)
+	{
+		Region *region = g_slice_new(Region);
+		region_init(view, region, REGION_TYPE_HEADER, nr);
+		
+		add_region(view, region);
+	}
+	else if (view->priv->last_region && view->priv->last_region->type == REGION_TYPE_HUNK)
+	{
+		hunk_add_line((Hunk *)view->priv->last_region, len > 0 ? *line : '\0');
+	}
 }
 
 static void
@@ -351,49 +708,14 @@ ensure_scan(GitgDiffView *view, guint last_line)
 	while (view->priv->last_scan_line <= last_line)
 	{
 		GtkTextIter start = iter;
-		GtkTextIter end = iter;
 
 		if (!gtk_text_iter_forward_line(&iter))
 			break;
 
 		++view->priv->last_scan_line;
 		
-		if (!gtk_text_iter_forward_chars(&end, 3))
-			continue;
-
-		gchar *text = gtk_text_iter_get_text(&start, &end);
-		
-		if (g_str_has_prefix(text, "@@ "))
-		{
-			/* start new hunk region */
-			Hunk *hunk = g_slice_new(Hunk);
-			hunk->region.type = REGION_TYPE_HUNK;
-			hunk->region.line = view->priv->last_scan_line - 1;
-			parse_hunk_info(hunk, &start);
-			
-			add_region(view, (Region *)hunk);
-			
-			g_free(text);
-			continue;
-		}
-		
-		g_free(text);
-
-		if (!gtk_text_iter_forward_chars(&end, 7))
-			continue;
-		
-		text = gtk_text_iter_get_text(&start, &end);
-		
-		if (g_str_has_prefix(text, "diff --git"))
-		{
-			/* start new header region */
-			Region *region = g_slice_new(Region);
-			region->type = REGION_TYPE_HEADER;
-			region->line = view->priv->last_scan_line - 1;
-			
-			add_region(view, region);
-		}
-		
+		gchar *text = gtk_text_iter_get_slice(&start, &iter);
+		scan_line(view, text, strlen(text), view->priv->last_scan_line - 1);
 		g_free(text);
 	}
 	
@@ -405,69 +727,33 @@ static Region *
 find_current_region(GitgDiffView *view, guint line)
 {
 	GSequenceIter *iter;
-	Region tmp = {0, NULL, line};
+	IndexKey key = {view, line};
 	
-	iter = g_sequence_search(view->priv->regions_index, &tmp, index_compare, NULL);
+	iter = g_sequence_search(view->priv->regions_index, NULL, index_compare, &key);
 	
-	if (!iter || g_sequence_iter_is_begin(iter))
+	if (!iter)
 		return NULL;
 
 	if (!g_sequence_iter_is_end(iter))
 	{
 		Region *ret = (Region *)g_sequence_get(iter); 
 	
-		if (ret->line == line)
+		if (region_line(view, ret) == line)
 			return ret;
 	}
+	
+	if (g_sequence_iter_is_begin(iter))
+		return NULL;
 	 
 	return (Region *)g_sequence_get(g_sequence_iter_prev(iter));
 }
 
-static gboolean
-line_has_prefix(GitgDiffView *view, guint line, gchar const *prefix)
-{
-	GtkTextIter iter;
-	
-	gtk_text_buffer_get_iter_at_line(gtk_text_view_get_buffer(GTK_TEXT_VIEW(view)), &iter, line);
-
-	GtkTextIter end = iter;
-	if (!gtk_text_iter_forward_chars(&end, g_utf8_strlen(prefix, -1)))
-		return FALSE;
-	
-	gchar *text = gtk_text_iter_get_text(&iter, &end);
-	gboolean ret = g_str_has_prefix(text, prefix);
-	g_free(text);
-	
-	return ret;
-}
-
-static gboolean
-draw_old(GitgDiffView *view, guint line)
-{
-	return !line_has_prefix(view, line, "+");
-}
-
-static gboolean
-draw_new(GitgDiffView *view, guint line)
-{
-	return !line_has_prefix(view, line, "-");
-}
-
-static void
-get_initial_counters(GitgDiffView *view, Region *region, guint line, guint counters[2])
+static Region *
+find_region_at(GitgDiffView *view, guint line)
 {
-	guint i;
+	Region *region = find_current_region(view, line);
 	
-	counters[0] = counters[1] = 0;
-	
-	for (i = region->line + 1; i < line; ++i)
-	{
-		if (draw_old(view, i))
-			++counters[0];
-		
-		if (draw_new(view, i))
-			++counters[1];
-	}
+	return region && region_line(view, region) == line ? region : NULL;
 }
 
 static void
@@ -483,10 +769,8 @@ paint_line_numbers(GitgDiffView *view, GdkEventExpose *event)
 	gint y1, y2;
 	gint count;
 	gint margin_width;
-	gint text_width, x_pixmap;
+	gint text_width;
 	gint i;
-	GtkTextIter cur;
-	gint cur_line;
 
 	text_view = GTK_TEXT_VIEW(view);
 	win = gtk_text_view_get_window(text_view, GTK_TEXT_WINDOW_LEFT);
@@ -520,11 +804,31 @@ paint_line_numbers(GitgDiffView *view, GdkEventExpose *event)
 	guint last = g_array_index(numbers, gint, count - 1);
 	ensure_scan(view, last);
 
-	/* set size */
-	g_snprintf(str_old, sizeof(str_old), "%d", MAX(99, view->priv->max_line_count));
-	layout = gtk_widget_create_pango_layout(GTK_WIDGET(view), str_old);
-
-	pango_layout_get_pixel_size(layout, &text_width, NULL);
+	/* the layout is kept, and only measured again when the largest line
+	   number changes */
+	guint max_line = MAX(99, view->priv->max_line_count);
+	
+	if (!view->priv->gutter_layout)
+	{
+		view->priv->gutter_layout = gtk_widget_create_pango_layout(GTK_WIDGET(view), NULL);
+		pango_layout_set_alignment(view->priv->gutter_layout, PANGO_ALIGN_RIGHT);
+		view->priv->gutter_max_line = 0;
+	}
+	
+	layout = view->priv->gutter_layout;
+	
+	if (view->priv->gutter_max_line != max_line)
+	{
+		g_snprintf(str_old, sizeof(str_old), "%u", max_line);
+		pango_layout_set_width(layout, -1);
+		pango_layout_set_text(layout, str_old, -1);
+		pango_layout_get_pixel_size(layout, &view->priv->gutter_width, NULL);
+		pango_layout_set_width(layout, view->priv->gutter_width);
+		
+		view->priv->gutter_max_line = max_line;
+	}
+	
+	text_width = view->priv->gutter_width;
 
 	/* determine the width of the left margin. */
 	margin_width = text_width * 2 + 9;
@@ -534,98 +838,253 @@ paint_line_numbers(GitgDiffView *view, GdkEventExpose *event)
 	if (gtk_source_view_get_show_line_marks(GTK_SOURCE_VIEW(view)))
 		extra_width = 20;
 
-	pango_layout_set_width(layout, text_width);
-	pango_layout_set_alignment(layout, PANGO_ALIGN_RIGHT);
-
 	gtk_text_view_set_border_window_size(GTK_TEXT_VIEW(text_view), GTK_TEXT_WINDOW_LEFT, margin_width + extra_width);
-	gtk_text_buffer_get_iter_at_mark(text_view->buffer, &cur, gtk_text_buffer_get_insert(text_view->buffer));
 
 	Region *current = NULL;
-	guint counters[2];
+	guint current_line = 0;
+	guint next_line = G_MAXUINT;
 
 	for (i = 0; i < count; ++i)
 	{
 		gint pos;
 		gint line_to_paint;
+		guint old = 0;
+		guint new = 0;
 
 		gtk_text_view_buffer_to_window_coords(text_view, GTK_TEXT_WINDOW_LEFT, 0, g_array_index(pixels, gint, i), NULL, &pos);
 		line_to_paint = g_array_index(numbers, gint, i);
 		
-		if (!current)
+		if (!current || line_to_paint >= next_line)
 		{
-			current = find_current_region(view, line_to_paint);
+			current = current ? current->next : find_current_region(view, line_to_paint);
 			
 			if (current)
-				get_initial_counters(view, current, line_to_paint, counters);
+			{
+				current_line = region_line(view, current);
+				next_line = current->next ? region_line(view, current->next) : G_MAXUINT;
+			}
 		}
 		
+		if (current && current->type == REGION_TYPE_HUNK)
+			hunk_line_numbers((Hunk *)current, current_line, line_to_paint, &old, &new);
+		
 		*str_old = '\0';
 		*str_new = '\0';
-
-		if (current && current->type == REGION_TYPE_HUNK && line_to_paint != current->line)
-		{
-			Hunk *hunk = (Hunk *)current;
-			
-			if (draw_old(view, line_to_paint))
-				g_snprintf(str_old, sizeof(str_old), "%d", hunk->old + counters[0]++);
-
-			if (draw_new(view, line_to_paint))
-				g_snprintf(str_new, sizeof(str_new), "%d", hunk->new + counters[1]++);
-		}
 		
-		pango_layout_set_markup(layout, str_old, -1);
+		if (old)
+			g_snprintf(str_old, sizeof(str_old), "%u", old);
+		
+		if (new)
+			g_snprintf(str_new, sizeof(str_new), "%u", new);
+		
+		pango_layout_set_text(layout, str_old, -1);
 		gtk_paint_layout(GTK_WIDGET(view)->style, win, GTK_WIDGET_STATE(view), FALSE, NULL, GTK_WIDGET(view), NULL, margin_width - 7 - text_width, pos, layout);
 
-		pango_layout_set_markup(layout, str_new, -1);
+		pango_layout_set_text(layout, str_new, -1);
 		gtk_paint_layout(GTK_WIDGET(view)->style, win, GTK_WIDGET_STATE(view), FALSE, NULL, GTK_WIDGET(view), NULL, margin_width - 2, pos, layout);
-
-		if (current && current->next && line_to_paint == current->next->line - 1)
-		{
-			counters[0] = counters[1] = 0;
-			current = current->next;
-		}
 	}
 	
 	gtk_paint_vline(GTK_WIDGET(view)->style, win, GTK_WIDGET_STATE(view), NULL, GTK_WIDGET(view), NULL, event->area.y, event->area.y + event->area.height, 4 + text_width);
 
 	g_array_free(pixels, TRUE);
 	g_array_free(numbers, TRUE);
-
-	g_object_unref(G_OBJECT(layout));
-}
-
-static gint 
-gitg_diff_view_expose(GtkWidget *widget, GdkEventExpose *event)
-{
-	gboolean ret = FALSE;
-	GtkTextView *text_view = GTK_TEXT_VIEW(widget);
-	GitgDiffView *view = GITG_DIFF_VIEW(widget);
-
-	if (event->window == gtk_text_view_get_window(text_view, GTK_TEXT_WINDOW_LEFT) && 
-	    view->priv->diff_enabled && gtk_source_view_get_show_line_numbers(GTK_SOURCE_VIEW(view)))
-	{
-		paint_line_numbers(GITG_DIFF_VIEW(widget), event);
-		ret = TRUE;
-	}
-
-	if (GTK_WIDGET_CLASS(gitg_diff_view_parent_class)->expose_event)
-		ret = ret || GTK_WIDGET_CLASS(gitg_diff_view_parent_class)->expose_event(widget, event);
-
-	return ret;
 }
 
-void
-gitg_diff_view_set_diff_enabled(GitgDiffView *view, gboolean enabled)
+static gchar *
+get_line_text(GitgDiffView *view, guint line)
 {
-	g_return_if_fail(GITG_IS_DIFF_VIEW(view));
-
-	set_diff_enabled(view, enabled);
-
-	g_object_notify(G_OBJECT(view), "diff-enabled");
+	GtkTextIter start;
+	GtkTextIter end;
+	
+	/* without the +/- prefix */
+	gtk_text_buffer_get_iter_at_line_offset(view->priv->current_buffer, &start, line, 1);
+	
+	if (gtk_text_iter_get_line(&start) != (gint)line || gtk_text_iter_get_bytes_in_line(&start) > MAX_WORD_DIFF_LINE_LENGTH)
+		return g_strdup("");
+	
+	end = start;
+	
+	if (!gtk_text_iter_ends_line(&end))
+		gtk_text_iter_forward_to_line_end(&end);
+	
+	return gtk_text_iter_get_slice(&start, &end);
 }
 
-void
-gitg_diff_view_remove_hunk(GitgDiffView *view, GtkTextIter *iter)
+/* Sends the changes of hunk between first and last that were not diffed
+   yet to the word diff worker. A change is a run of removed lines followed
+   by a run of added lines, paired line by line */
+static void
+queue_hunk_word_diff(GitgDiffView *view, Hunk *hunk, guint first, guint last)
+{
+	guint hunk_line = region_line(view, (Region *)hunk);
+	gboolean complete = hunk->region.next || view->priv->last_scan_line >= (guint)gtk_text_buffer_get_line_count(view->priv->current_buffer) - 1;
+	guint i;
+	
+	for (i = 0; i + 1 < hunk->runs->len; ++i)
+	{
+		HunkRun *removed = &g_array_index(hunk->runs, HunkRun, i);
+		HunkRun *added = &g_array_index(hunk->runs, HunkRun, i + 1);
+		
+		if (removed->type != LINE_TYPE_REMOVED || added->type != LINE_TYPE_ADDED || removed->word_diff)
+			continue;
+		
+		/* the last run of a hunk that is still being scanned may grow */
+		if (i + 2 == hunk->runs->len && !complete)
+			break;
+		
+		guint added_end = i + 2 < hunk->runs->len ? g_array_index(hunk->runs, HunkRun, i + 2).offset : hunk->num_lines + 1;
+		
+		if (hunk_line + added_end <= first || hunk_line + removed->offset > last)
+			continue;
+		
+		guint num_removed = added->offset - removed->offset;
+		guint num = MIN(num_removed, added_end - added->offset);
+		
+		removed->word_diff = TRUE;
+		
+		if (num > MAX_WORD_DIFF_LINES)
+			continue;
+		
+		if (!hunk->serial)
+		{
+			hunk->serial = ++view->priv->word_diff_serial;
+			g_hash_table_insert(view->priv->word_diff_hunks, GUINT_TO_POINTER(hunk->serial), hunk);
+		}
+		
+		GitgWordDiffBlock *block = gitg_word_diff_block_new(num);
+		guint j;
+		
+		block->id = hunk->serial;
+		block->index = i;
+		
+		for (j = 0; j < num; ++j)
+		{
+			block->removed[j] = get_line_text(view, hunk_line + removed->offset + j);
+			block->added[j] = get_line_text(view, hunk_line + added->offset + j);
+		}
+		
+		gitg_word_diff_push(view->priv->word_diff, block);
+	}
+}
+
+static gboolean
+on_word_diff_idle(GitgDiffView *view)
+{
+	GtkTextView *text_view = GTK_TEXT_VIEW(view);
+	GdkRectangle rect;
+	GtkTextIter iter;
+	
+	view->priv->word_diff_id = 0;
+	
+	if (!view->priv->diff_enabled)
+		return FALSE;
+	
+	gtk_text_view_get_visible_rect(text_view, &rect);
+	gtk_text_view_get_line_at_y(text_view, &iter, rect.y, NULL);
+	guint first = gtk_text_iter_get_line(&iter);
+	
+	gtk_text_view_get_line_at_y(text_view, &iter, rect.y + rect.height, NULL);
+	guint last = gtk_text_iter_get_line(&iter);
+	
+	ensure_scan(view, last);
+	
+	Region *region = find_current_region(view, first);
+	
+	if (!region)
+		region = view->priv->regions;
+	
+	for (; region && region_line(view, region) <= last; region = region->next)
+	{
+		if (region->type == REGION_TYPE_HUNK)
+			queue_hunk_word_diff(view, (Hunk *)region, first, last);
+	}
+	
+	return FALSE;
+}
+
+static void
+on_word_diff_done(GitgWordDiff *diff, GitgDiffView *view)
+{
+	GitgWordDiffBlock *block;
+	
+	while ((block = gitg_word_diff_pop(diff)))
+	{
+		Hunk *hunk = (Hunk *)g_hash_table_lookup(view->priv->word_diff_hunks, GUINT_TO_POINTER(block->id));
+		guint i;
+		
+		/* the hunk was removed meanwhile */
+		if (!hunk || !view->priv->diff_enabled)
+		{
+			gitg_word_diff_block_free(block);
+			continue;
+		}
+		
+		guint hunk_line = region_line(view, (Region *)hunk);
+		HunkRun *removed = &g_array_index(hunk->runs, HunkRun, block->index);
+		HunkRun *added = &g_array_index(hunk->runs, HunkRun, block->index + 1);
+		
+		for (i = 0; i < block->ranges->len; ++i)
+		{
+			GitgWordDiffRange *range = &g_array_index(block->ranges, GitgWordDiffRange, i);
+			guint line = hunk_line + (range->added ? added->offset : removed->offset) + range->line;
+			GtkTextIter start;
+			GtkTextIter end;
+			
+			/* the ranges are bytes after the +/- prefix */
+			gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &start, line);
+			
+			if (gtk_text_iter_get_bytes_in_line(&start) <= (gint)range->end)
+				continue;
+			
+			gtk_text_buffer_get_iter_at_line_index(view->priv->current_buffer, &start, line, range->start + 1);
+			gtk_text_buffer_get_iter_at_line_index(view->priv->current_buffer, &end, line, range->end + 1);
+			
+			gtk_text_buffer_apply_tag(view->priv->current_buffer, view->priv->tags[range->added ? TAG_WORD_ADDED : TAG_WORD_REMOVED], &start, &end);
+		}
+		
+		gitg_word_diff_block_free(block);
+	}
+}
+
+static gint 
+gitg_diff_view_expose(GtkWidget *widget, GdkEventExpose *event)
+{
+	gboolean ret = FALSE;
+	GtkTextView *text_view = GTK_TEXT_VIEW(widget);
+	GitgDiffView *view = GITG_DIFF_VIEW(widget);
+
+	if (event->window == gtk_text_view_get_window(text_view, GTK_TEXT_WINDOW_LEFT) && 
+	    view->priv->diff_enabled && gtk_source_view_get_show_line_numbers(GTK_SOURCE_VIEW(view)))
+	{
+		paint_line_numbers(GITG_DIFF_VIEW(widget), event);
+		ret = TRUE;
+	}
+	
+	/* word diffs are made for what is shown */
+	if (event->window == gtk_text_view_get_window(text_view, GTK_TEXT_WINDOW_TEXT) && 
+	    view->priv->diff_enabled && !view->priv->word_diff_id)
+	{
+		view->priv->word_diff_id = g_idle_add((GSourceFunc)on_word_diff_idle, view);
+	}
+
+	if (GTK_WIDGET_CLASS(gitg_diff_view_parent_class)->expose_event)
+		ret = ret || GTK_WIDGET_CLASS(gitg_diff_view_parent_class)->expose_event(widget, event);
+
+	return ret;
+}
+
+void
+gitg_diff_view_set_diff_enabled(GitgDiffView *view, gboolean enabled)
+{
+	g_return_if_fail(GITG_IS_DIFF_VIEW(view));
+
+	set_diff_enabled(view, enabled);
+
+	g_object_notify(G_OBJECT(view), "diff-enabled");
+}
+
+void
+gitg_diff_view_remove_hunk(GitgDiffView *view, GtkTextIter *iter)
 {
 	g_return_if_fail(GITG_IS_DIFF_VIEW(view));
 	
@@ -639,31 +1098,216 @@ gitg_diff_view_remove_hunk(GitgDiffView *view, GtkTextIter *iter)
 	GtkTextIter start;
 	GtkTextIter end;
 	
-	gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &start, region->line);
+	gtk_text_buffer_get_iter_at_mark(view->priv->current_buffer, &start, region->mark);
 	
 	if (region->next)
-	{
-		gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &end, region->next->line - 1);
-		gtk_text_iter_forward_line(&end);
-	}
+		gtk_text_buffer_get_iter_at_mark(view->priv->current_buffer, &end, region->next->mark);
 	else
-	{
 		gtk_text_buffer_get_end_iter(view->priv->current_buffer, &end);
-	}
 	
-	Region *prev = find_current_region(view, region->line - 1);
+	Region *prev = g_sequence_iter_is_begin(region->iter) ? NULL : (Region *)g_sequence_get(g_sequence_iter_prev(region->iter));
 	
 	if ((!region->next || region->next->type == REGION_TYPE_HEADER) && (!prev || prev->type == REGION_TYPE_HEADER))
 	{
 		if (!prev)
 			gtk_text_buffer_get_start_iter(view->priv->current_buffer, &start);
 		else
-			gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &start, region->line);
+			gtk_text_buffer_get_iter_at_mark(view->priv->current_buffer, &start, prev->mark);
 	}
 	
 	gtk_text_buffer_delete(view->priv->current_buffer, &start, &end);
 }
 
+static void
+add_row(GArray *rows, gint old, gint new, GitgDiffViewRowType type)
+{
+	GitgDiffViewRow row = {old, new, type};
+	g_array_append_val(rows, row);
+}
+
+static guint
+add_hunk_rows(GitgDiffView *view, Hunk *hunk, guint line, GArray *rows)
+{
+	guint i;
+	guint j;
+	
+	add_row(rows, line, line, GITG_DIFF_VIEW_ROW_HUNK);
+	
+	for (i = 0; i < hunk->runs->len; ++i)
+	{
+		HunkRun *run = &g_array_index(hunk->runs, HunkRun, i);
+		HunkRun *next = i + 1 < hunk->runs->len ? &g_array_index(hunk->runs, HunkRun, i + 1) : NULL;
+		guint num = (next ? next->offset : hunk->num_lines + 1) - run->offset;
+		
+		if (run->type == LINE_TYPE_CONTEXT)
+		{
+			for (j = 0; j < num; ++j)
+				add_row(rows, line + run->offset + j, line + run->offset + j, GITG_DIFF_VIEW_ROW_CONTEXT);
+			
+			continue;
+		}
+		
+		/* removed lines are aligned with the added lines following them */
+		guint num_removed = run->type == LINE_TYPE_REMOVED ? num : 0;
+		guint num_added = run->type == LINE_TYPE_ADDED ? num : 0;
+		guint removed = line + run->offset;
+		guint added = line + run->offset;
+		
+		if (run->type == LINE_TYPE_REMOVED && next && next->type == LINE_TYPE_ADDED)
+		{
+			HunkRun *after = i + 2 < hunk->runs->len ? &g_array_index(hunk->runs, HunkRun, i + 2) : NULL;
+			
+			added = line + next->offset;
+			num_added = (after ? after->offset : hunk->num_lines + 1) - next->offset;
+			++i;
+		}
+		
+		for (j = 0; j < MAX(num_removed, num_added); ++j)
+			add_row(rows, j < num_removed ? (gint)(removed + j) : -1, j < num_added ? (gint)(added + j) : -1, GITG_DIFF_VIEW_ROW_CHANGE);
+	}
+	
+	return line + hunk->num_lines + 1;
+}
+
+/* Fills rows with the side by side layout of the whole buffer, lines of a
+   hunk are aligned from its header on. When serial is that of the last
+   call, only text was appended since and the rows are laid out again from
+   the region of their last line on */
+void
+gitg_diff_view_get_rows(GitgDiffView *view, GArray *rows, guint *serial)
+{
+	g_return_if_fail(GITG_IS_DIFF_VIEW(view));
+	
+	if (!view->priv->current_buffer)
+	{
+		g_array_set_size(rows, 0);
+		return;
+	}
+	
+	ensure_scan(view, G_MAXUINT);
+	
+	GtkTextIter iter;
+	guint count = gtk_text_buffer_get_line_count(view->priv->current_buffer);
+	
+	/* without the empty line after the last newline */
+	gtk_text_buffer_get_end_iter(view->priv->current_buffer, &iter);
+	
+	if (count > 1 && gtk_text_iter_starts_line(&iter))
+		--count;
+	
+	GitgDiffViewRowType type = GITG_DIFF_VIEW_ROW_TEXT;
+	Region *region = view->priv->regions;
+	guint line = 0;
+	
+	if (*serial == view->priv->rows_serial && rows->len)
+	{
+		GitgDiffViewRow *row = &g_array_index(rows, GitgDiffViewRow, rows->len - 1);
+		guint len = rows->len;
+		
+		line = MAX(row->old, row->new);
+		region = find_current_region(view, line);
+		
+		if (region)
+			line = region_line(view, region);
+		else
+			region = view->priv->regions;
+		
+		for (; len; --len)
+		{
+			row = &g_array_index(rows, GitgDiffViewRow, len - 1);
+			
+			if ((guint)MAX(row->old, row->new) < line)
+				break;
+		}
+		
+		g_array_set_size(rows, len);
+	}
+	else
+	{
+		g_array_set_size(rows, 0);
+	}
+	
+	*serial = view->priv->rows_serial;
+	
+	while (TRUE)
+	{
+		guint start = region ? region_line(view, region) : count;
+		
+		for (; line < MIN(start, count); ++line)
+			add_row(rows, line, line, type);
+		
+		if (!region)
+			break;
+		
+		if (region->type == REGION_TYPE_HEADER)
+		{
+			type = GITG_DIFF_VIEW_ROW_HEADER;
+		}
+		else
+		{
+			line = add_hunk_rows(view, (Hunk *)region, start, rows);
+			type = GITG_DIFF_VIEW_ROW_TEXT;
+		}
+		
+		region = region->next;
+	}
+}
+
+/* The colors the diff is tagged with for rows of type, on the old or the
+   new side. NULL when the colors of the view are used, free them with
+   gdk_color_free */
+void
+gitg_diff_view_get_row_colors(GitgDiffView *view, GitgDiffViewRowType type, gboolean new_side, GdkColor **foreground, GdkColor **background)
+{
+	g_return_if_fail(GITG_IS_DIFF_VIEW(view));
+	
+	TagType tag;
+	gboolean fg_set = FALSE;
+	gboolean bg_set = FALSE;
+	
+	*foreground = NULL;
+	*background = NULL;
+	
+	switch (type)
+	{
+		case GITG_DIFF_VIEW_ROW_HEADER:
+			tag = TAG_FILE;
+		break;
+		case GITG_DIFF_VIEW_ROW_HUNK:
+			tag = TAG_LOCATION;
+		break;
+		case GITG_DIFF_VIEW_ROW_CHANGE:
+			tag = new_side ? TAG_ADDED : TAG_REMOVED;
+		break;
+		default:
+			return;
+	}
+	
+	if (!view->priv->tags[tag])
+		return;
+	
+	g_object_get(view->priv->tags[tag], "foreground-set", &fg_set, "paragraph-background-set", &bg_set, NULL);
+	
+	if (fg_set)
+		g_object_get(view->priv->tags[tag], "foreground-gdk", foreground, NULL);
+	
+	if (bg_set)
+		g_object_get(view->priv->tags[tag], "paragraph-background-gdk", background, NULL);
+}
+
+void
+gitg_diff_view_get_line_numbers(GitgDiffView *view, guint line, guint *old, guint *new)
+{
+	g_return_if_fail(GITG_IS_DIFF_VIEW(view));
+	
+	Region *region = find_current_region(view, line);
+	
+	*old = *new = 0;
+	
+	if (region && region->type == REGION_TYPE_HUNK)
+		hunk_line_numbers((Hunk *)region, region_line(view, region), line, old, new);
+}
+
 static gboolean 
 iter_in_view(GitgDiffView *view, GtkTextIter *iter)
 {
@@ -706,15 +1350,285 @@ try_scan(GitgDiffView *view)
 	return last != view->priv->last_scan_line;
 }
 
+static TagType
+classify_line(GitgDiffView *view, gint line_nr, gchar const *line, gsize len)
+{
+	/* a line completed by a later insert starts from the same state */
+	if (line_nr == view->priv->tag_last_line)
+		view->priv->tag_in_header = view->priv->tag_header_before;
+	else
+		view->priv->tag_header_before = view->priv->tag_in_header;
+	
+	view->priv->tag_last_line = line_nr;
+	
+	/* the file header runs from diff --git up to the +++ line */
+	if (len >= 10 && strncmp(line, "diff --git", 10) == 0)
+	{
+		view->priv->tag_in_header = TRUE;
+		return TAG_FILE;
+	}
+	
+	if (view->priv->tag_in_header)
+	{
+		if (len >= 4 && strncmp(line, "+++ ", 4) == 0)
+			view->priv->tag_in_header = FALSE;
+		
+		return TAG_FILE;
+	}
+	
+	if (len == 0)
+		return TAG_NONE;
+	
+	switch (*line)
+	{
+		case '@':
+			return len >= 3 && strncmp(line, "@@ ", 3) == 0 ? TAG_LOCATION : TAG_NONE;
+		case '+':
+			return TAG_ADDED;
+		case '-':
+			return TAG_REMOVED;
+		default:
+			return TAG_NONE;
+	}
+}
+
+static void
+apply_line_tag(GitgDiffView *view, TagType type, gint first, gint last)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	
+	if (type == TAG_NONE)
+		return;
+	
+	gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &start, first);
+	gtk_text_buffer_get_iter_at_line(view->priv->current_buffer, &end, last);
+	
+	if (!gtk_text_iter_ends_line(&end))
+		gtk_text_iter_forward_to_line_end(&end);
+	
+	gtk_text_buffer_apply_tag(view->priv->current_buffer, view->priv->tags[type], &start, &end);
+}
+
+/* Tags the inserted lines and, when text was appended to a scanned buffer,
+   makes the regions from the inserted lines directly. Other edits leave
+   the regions to the buffer scan, returns TRUE when text was inserted in
+   lines that were already scanned */
+static gboolean
+scan_inserted_text(GitgDiffView *view, GtkTextIter *end, gchar const *text, gint len)
+{
+	GtkTextIter start = *end;
+	gchar *first = NULL;
+	gboolean tag = view->priv->diff_enabled;
+	guint i;
+	
+	if (len < 0)
+		len = strlen(text);
+	
+	gtk_text_iter_backward_chars(&start, g_utf8_strlen(text, len));
+	
+	gboolean stream = gtk_text_iter_starts_line(&start) &&
+	                  gtk_text_iter_is_end(end) &&
+	                  (guint)gtk_text_iter_get_line(&start) == view->priv->last_scan_line;
+	
+	gboolean invalid = !stream && (guint)gtk_text_iter_get_line(&start) < view->priv->last_scan_line;
+	
+	if (!tag && !stream)
+		return invalid;
+	
+	/* text inserted in the middle of a line, classify the whole line */
+	if (tag && !gtk_text_iter_starts_line(&start))
+	{
+		GtkTextIter line_start = start;
+		GtkTextIter line_end;
+		
+		gtk_text_iter_set_line_offset(&line_start, 0);
+		line_end = line_start;
+		
+		if (!gtk_text_iter_ends_line(&line_end))
+			gtk_text_iter_forward_to_line_end(&line_end);
+		
+		first = gtk_text_iter_get_text(&line_start, &line_end);
+		
+		/* the line is tagged again as a whole */
+		for (i = TAG_FILE; i <= TAG_REMOVED; ++i)
+		{
+			if (view->priv->tags[i])
+				gtk_text_buffer_remove_tag(view->priv->current_buffer, view->priv->tags[i], &line_start, &line_end);
+		}
+	}
+	
+	/* a single pass over the inserted lines, applying each tag once for
+	   a run of lines of the same type */
+	gchar const *ptr = text;
+	gchar const *bound = text + len;
+	gint line = gtk_text_iter_get_line(&start);
+	gint run_start = line;
+	TagType run_type = TAG_NONE;
+	
+	while (ptr < bound)
+	{
+		gchar const *nl = memchr(ptr, '\n', bound - ptr);
+		gchar const *eol = nl ? nl : bound;
+		TagType type = TAG_NONE;
+		
+		/* only complete lines are scanned */
+		if (stream && nl)
+		{
+			scan_line(view, ptr, eol - ptr, line);
+			++view->priv->last_scan_line;
+		}
+		
+		if (tag && first)
+		{
+			type = classify_line(view, line, first, strlen(first));
+			g_free(first);
+			first = NULL;
+		}
+		else if (tag)
+		{
+			type = classify_line(view, line, ptr, eol - ptr);
+		}
+		
+		if (type != run_type)
+		{
+			apply_line_tag(view, run_type, run_start, line - 1);
+			
+			run_type = type;
+			run_start = line;
+		}
+		
+		if (!nl)
+			break;
+		
+		ptr = nl + 1;
+		++line;
+	}
+	
+	if (ptr == bound)
+		--line;
+	
+	apply_line_tag(view, run_type, run_start, line);
+	g_free(first);
+	
+	if (stream && view->priv->last_region && view->priv->last_region->type == REGION_TYPE_HUNK)
+		ensure_max_line(view, (Hunk *)view->priv->last_region);
+	
+	return invalid;
+}
+
+static void
+check_highlight_size(GitgDiffView *view)
+{
+	if (view->priv->highlight_disabled || !view->priv->max_highlight_size || !GTK_IS_SOURCE_BUFFER(view->priv->current_buffer))
+		return;
+	
+	if (gtk_text_buffer_get_char_count(view->priv->current_buffer) > view->priv->max_highlight_size)
+	{
+		view->priv->highlight_disabled = TRUE;
+		gtk_source_buffer_set_highlight_syntax(GTK_SOURCE_BUFFER(view->priv->current_buffer), FALSE);
+	}
+}
+
+/* Removes the regions starting in [start, end) when the deleted text runs
+   from the start of a region up to the start of another region or the end
+   of the buffer. The marks of the regions after it move along. Any other
+   deletion makes the buffer be scanned again */
+static void
+on_buffer_before_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, GitgDiffView *view)
+{
+	guint start_line = gtk_text_iter_get_line(start);
+	guint end_line = gtk_text_iter_get_line(end);
+	
+	if (start_line >= view->priv->last_scan_line || gtk_text_iter_equal(start, end))
+		return;
+	
+	Region *first = gtk_text_iter_starts_line(start) ? find_region_at(view, start_line) : NULL;
+	Region *last = NULL;
+	
+	if (!first || (!gtk_text_iter_is_end(end) && !(gtk_text_iter_starts_line(end) && (last = find_region_at(view, end_line)))))
+	{
+		view->priv->regions_invalid = TRUE;
+		return;
+	}
+	
+	/* unlink first up to last */
+	GSequenceIter *from = first->iter;
+	GSequenceIter *to = last ? last->iter : g_sequence_get_end_iter(view->priv->regions_index);
+	Region *prev = g_sequence_iter_is_begin(from) ? NULL : (Region *)g_sequence_get(g_sequence_iter_prev(from));
+	Region *region;
+	
+	for (region = first; region->next != last; region = region->next)
+		;
+	
+	region->next = view->priv->deleted_regions;
+	view->priv->deleted_regions = first;
+	
+	g_sequence_remove_range(from, to);
+	
+	if (prev)
+		prev->next = last;
+	else
+		view->priv->regions = last;
+	
+	if (!last)
+		view->priv->last_region = prev;
+	
+	/* the scanned lines after the deletion move up */
+	if (gtk_text_iter_is_end(end) || view->priv->last_scan_line <= end_line)
+		view->priv->last_scan_line = start_line;
+	else
+		view->priv->last_scan_line -= end_line - start_line;
+}
+
 static void
 on_buffer_delete_range(GtkTextBuffer *buffer, GtkTextIter *start, GtkTextIter *end, GitgDiffView *view)
 {
-	regions_free(view, FALSE);
+	view->priv->rows_serial++;
+	
+	if (view->priv->regions_invalid)
+	{
+		regions_free(view, FALSE);
+	}
+	else
+	{
+		region_free(view, view->priv->deleted_regions);
+		view->priv->deleted_regions = NULL;
+	}
+	
+	/* a new diff is loaded in the same buffer */
+	if (gtk_text_buffer_get_char_count(buffer) == 0)
+	{
+		restore_highlight(view);
+		view->priv->tag_in_header = FALSE;
+		view->priv->tag_last_line = -1;
+	}
 }
 
 static void 
 on_buffer_insert_text(GtkTextBuffer *buffer, GtkTextIter *iter, gchar const *text, gint len, GitgDiffView *view)
 {
+	guint max_line_count = view->priv->max_line_count;
+	
+	if (view->priv->diff_enabled)
+		check_highlight_size(view);
+	
+	if (!gtk_text_iter_is_end(iter))
+		view->priv->rows_serial++;
+	
+	/* text inserted in the scanned lines, the scan starts over */
+	if (scan_inserted_text(view, iter, text, len))
+		regions_free(view, FALSE);
+	
+	/* appended lines were scanned while inserting */
+	if ((guint)gtk_text_iter_get_line(iter) <= view->priv->last_scan_line)
+	{
+		if (max_line_count != view->priv->max_line_count)
+			gtk_widget_queue_draw(GTK_WIDGET(view));
+		
+		return;
+	}
+	
 	/* if region is in current view and not scanned, issue scan now */
 	if (iter_in_view(view, iter))
 		try_scan(view);
@@ -13,6 +13,24 @@ G_BEGIN_DECLS
 #define GITG_IS_DIFF_VIEW_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE ((klass), GITG_TYPE_DIFF_VIEW))
 #define GITG_DIFF_VIEW_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS ((obj), GITG_TYPE_DIFF_VIEW, GitgDiffViewClass))
 
+typedef enum
+{
+	GITG_DIFF_VIEW_ROW_TEXT,
+	GITG_DIFF_VIEW_ROW_HEADER,
+	GITG_DIFF_VIEW_ROW_HUNK,
+	GITG_DIFF_VIEW_ROW_CONTEXT,
+	GITG_DIFF_VIEW_ROW_CHANGE
+} GitgDiffViewRowType;
+
+/* A row of the diff shown side by side: the buffer lines of the old and the
+   new side, -1 for none. Rows other than changes show one line on both */
+typedef struct
+{
+	gint old;
+	gint new;
+	GitgDiffViewRowType type;
+} GitgDiffViewRow;
+
 typedef struct _GitgDiffView		GitgDiffView;
 typedef struct _GitgDiffViewClass	GitgDiffViewClass;
 typedef struct _GitgDiffViewPrivate	GitgDiffViewPrivate;
@@ -31,8 +49,13 @@ struct _GitgDiffViewClass
 
 GType gitg_diff_view_get_type(void) G_GNUC_CONST;
 GitgDiffView *gitg_diff_view_new(void);
+void gitg_diff_view_set_diff_enabled(GitgDiffView *view, gboolean enabled);
 void gitg_diff_view_remove_hunk(GitgDiffView *view, GtkTextIter *iter);
 
+void gitg_diff_view_get_rows(GitgDiffView *view, GArray *rows, guint *serial);
+void gitg_diff_view_get_row_colors(GitgDiffView *view, GitgDiffViewRowType type, gboolean new_side, GdkColor **foreground, GdkColor **background);
+void gitg_diff_view_get_line_numbers(GitgDiffView *view, guint line, guint *old, guint *new);
+
 G_END_DECLS
 
 #endif /* __GITG_DIFF_VIEW_H__ */
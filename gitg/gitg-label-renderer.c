@@ -5,6 +5,94 @@
 #define PADDING 4
 #define MARGIN 3
 
+#define LABEL_CACHE_KEY "gitg-label-cache"
+
+typedef struct
+{
+	PangoLayout *layout;
+	gint width;
+	gint height;
+} LabelLayout;
+
+/* shaped labels of a widget, by ref name */
+typedef struct
+{
+	PangoFontDescription *font;
+	GHashTable *layouts;
+} LabelCache;
+
+static void
+free_label_layout(LabelLayout *label)
+{
+	g_object_unref(label->layout);
+	g_slice_free(LabelLayout, label);
+}
+
+static void
+free_label_cache(LabelCache *cache)
+{
+	if (cache->font)
+		pango_font_description_free(cache->font);
+
+	g_hash_table_destroy(cache->layouts);
+	g_slice_free(LabelCache, cache);
+}
+
+static void
+on_style_set(GtkWidget *widget, GtkStyle *previous, LabelCache *cache)
+{
+	/* theme or font changed */
+	g_hash_table_remove_all(cache->layouts);
+}
+
+static LabelCache *
+get_label_cache(GtkWidget *widget, PangoFontDescription *font)
+{
+	LabelCache *cache = (LabelCache *)g_object_get_data(G_OBJECT(widget), LABEL_CACHE_KEY);
+	
+	if (!cache)
+	{
+		cache = g_slice_new0(LabelCache);
+		cache->layouts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_label_layout);
+		
+		g_object_set_data_full(G_OBJECT(widget), LABEL_CACHE_KEY, cache, (GDestroyNotify)free_label_cache);
+		g_signal_connect(widget, "style-set", G_CALLBACK(on_style_set), cache);
+	}
+	
+	if (!cache->font || !pango_font_description_equal(cache->font, font))
+	{
+		if (cache->font)
+			pango_font_description_free(cache->font);
+		
+		cache->font = pango_font_description_copy(font);
+		g_hash_table_remove_all(cache->layouts);
+	}
+	
+	return cache;
+}
+
+static LabelLayout *
+get_label_layout(LabelCache *cache, GtkWidget *widget, GitgRef *ref)
+{
+	LabelLayout *label = (LabelLayout *)g_hash_table_lookup(cache->layouts, ref->shortname);
+	
+	if (label)
+		return label;
+	
+	label = g_slice_new(LabelLayout);
+	label->layout = pango_layout_new(gtk_widget_get_pango_context(widget));
+	pango_layout_set_font_description(label->layout, cache->font);
+	
+	gchar *smaller = g_markup_printf_escaped("<span size='smaller'>%s</span>", ref->shortname);
+	pango_layout_set_markup(label->layout, smaller, -1);
+	g_free(smaller);
+	
+	pango_layout_get_pixel_size(label->layout, &label->width, &label->height);
+	g_hash_table_insert(cache->layouts, g_strdup(ref->shortname), label);
+	
+	return label;
+}
+
 gint
 gitg_label_renderer_width(GtkWidget *widget, PangoFontDescription *font, GSList *labels)
 {
@@ -14,26 +102,14 @@ gitg_label_renderer_width(GtkWidget *widget, PangoFontDescription *font, GSList
 	if (labels == NULL)
 		return 0;
 
-	PangoContext *ctx = gtk_widget_get_pango_context(widget);
-	PangoLayout *layout = pango_layout_new(ctx);
-	pango_layout_set_font_description(layout, font);
+	LabelCache *cache = get_label_cache(widget, font);
 	
 	for (item = labels; item; item = item->next)
 	{
-		gint w;
-		GitgRef *ref = (GitgRef *)item->data;
-		gchar *smaller = g_strdup_printf("<span size='smaller'>%s</span>", ref->shortname);
-		pango_layout_set_markup(layout, smaller, -1);
-		
-		pango_layout_get_pixel_size(layout, &w, NULL);
-		
-		width += w + PADDING * 2 + MARGIN;
-		g_free(smaller);
+		LabelLayout *label = get_label_layout(cache, widget, (GitgRef *)item->data);
+		width += label->width + PADDING * 2 + MARGIN;
 	}
 	
-	g_object_unref(layout);
-	//g_object_unref(ctx);
-	
 	return width + MARGIN;
 }
 
@@ -80,22 +156,20 @@ gitg_label_renderer_draw(GtkWidget *widget, PangoFontDescription *font, cairo_t
 	GSList *item;
 	double pos = MARGIN + 0.5;
 
+	if (labels == NULL)
+		return;
+
 	cairo_save(context);
 	cairo_set_line_width(context, 1.0);
 
-	PangoContext *ctx = gtk_widget_get_pango_context(widget);
-	PangoLayout *layout = pango_layout_new(ctx);
-	pango_layout_set_font_description(layout, font);
+	LabelCache *cache = get_label_cache(widget, font);
 
 	for (item = labels; item; item = item->next)
 	{
 		GitgRef *ref = (GitgRef *)item->data;
-		gint w;
-		gint h;
-		gchar *smaller = g_strdup_printf("<span size='smaller'>%s</span>", ref->shortname);
-		
-		pango_layout_set_markup(layout, smaller, -1);
-		pango_layout_get_pixel_size(layout, &w, &h);
+		LabelLayout *label = get_label_layout(cache, widget, ref);
+		gint w = label->width;
+		gint h = label->height;
 		
 		// draw rounded rectangle
 		rounded_rectangle(context, pos + 0.5, area->y + MARGIN + 0.5, w + PADDING * 2, area->height - MARGIN * 2, 5);
@@ -109,13 +183,11 @@ gitg_label_renderer_draw(GtkWidget *widget, PangoFontDescription *font, cairo_t
 		
 		cairo_save(context);
 		cairo_translate(context, pos + PADDING, area->y + (area->height - h) / 2.0 + 0.5);
-		pango_cairo_show_layout(context, layout);
+		pango_cairo_show_layout(context, label->layout);
 		cairo_restore(context);
 		
 		pos += w + PADDING * 2 + MARGIN;
-		g_free(smaller);
 	}
 	
-	g_object_unref(layout);
 	cairo_restore(context);
 }
@@ -1,64 +1,321 @@
 #include "gitg-lane.h"
+#include <string.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* color -> palette index, can be shared between arenas */
+typedef struct
+{
+	gint ref_count;
+
+	gint8 *colors;
+	guint32 num;
+	guint32 allocated;
+} ColorTable;
+
+struct _GitgLaneArena
+{
+	gint ref_count;
+
+	/* packed rows, chunks are never moved or freed before the arena */
+	GSList *chunks;
+	guint8 *current;
+	gsize left;
+
+	ColorTable *colors;
+};
 
 /* GitgLane functions */
-GitgLane *
-gitg_lane_copy(GitgLane *lane)
+void
+gitg_lane_init(GitgLane *lane, guint32 color)
 {
-	GitgLane *copy = g_slice_new(GitgLane);
-	copy->color = gitg_color_ref(lane->color);
-	copy->from = g_slist_copy(lane->from);
-	copy->type = lane->type;
+	lane->color = color;
+	lane->type = GITG_LANE_TYPE_NONE;
+	lane->num_from = 0;
+	lane->hash = NULL;
+}
 
-	return copy;
+void
+gitg_lane_add_from(GitgLane *lane, gint8 from)
+{
+	static gboolean warned = FALSE;
+
+	if (lane->num_from < GITG_LANE_MAX_FROM)
+	{
+		lane->from[lane->num_from++] = from;
+	}
+	else if (!warned)
+	{
+		g_warning("More than %d lanes merge on a lane, the others are not drawn", GITG_LANE_MAX_FROM);
+		warned = TRUE;
+	}
 }
 
-GitgLane *
-gitg_lane_dup(GitgLane *lane)
+gsize
+gitg_lane_packed_size(GitgLane const *lane)
 {
-	GitgLane *dup = g_slice_new(GitgLane);
-	dup->color = gitg_color_copy(lane->color);
-	dup->from = g_slist_copy(lane->from);
-	dup->type = lane->type;
-	
-	return dup;
+	gsize size = 6 + lane->num_from;
+
+	if (GITG_IS_LANE_BOUNDARY(lane))
+		size += sizeof(Hash);
+
+	return size;
 }
 
-void
-gitg_lane_free(GitgLane *lane)
+guint8 *
+gitg_lane_pack(GitgLane const *lane, guint8 *ptr)
 {
-	gitg_color_unref(lane->color);
-	g_slist_free(lane->from);
-	
+	*ptr++ = (guint8)lane->type;
+	*ptr++ = lane->color & 0xff;
+	*ptr++ = (lane->color >> 8) & 0xff;
+	*ptr++ = (lane->color >> 16) & 0xff;
+	*ptr++ = (lane->color >> 24) & 0xff;
+	*ptr++ = lane->num_from;
+
+	memcpy(ptr, lane->from, lane->num_from);
+	ptr += lane->num_from;
+
 	if (GITG_IS_LANE_BOUNDARY(lane))
-		g_slice_free(GitgLaneBoundary, (GitgLaneBoundary *)lane);
+	{
+		if (lane->hash)
+			memcpy(ptr, lane->hash, sizeof(Hash));
+		else
+			memset(ptr, 0, sizeof(Hash));
+
+		ptr += sizeof(Hash);
+	}
+
+	return ptr;
+}
+
+guint8 const *
+gitg_lane_unpack(guint8 const *ptr, GitgLane *lane)
+{
+	lane->type = (gint8)*ptr++;
+	lane->color = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((guint32)ptr[3] << 24);
+	ptr += 4;
+
+	lane->num_from = *ptr++;
+	memcpy(lane->from, ptr, lane->num_from);
+	ptr += lane->num_from;
+
+	if (GITG_IS_LANE_BOUNDARY(lane))
+	{
+		lane->hash = (gchar const *)ptr;
+		ptr += sizeof(Hash);
+	}
 	else
-		g_slice_free(GitgLane, lane);
+	{
+		lane->hash = NULL;
+	}
+
+	return ptr;
 }
 
-GitgLane *
-gitg_lane_new()
+guint
+gitg_lane_row_length(guint8 const *row)
 {
-	return gitg_lane_new_with_color(NULL);
+	return row ? *row : 0;
 }
 
-GitgLane *
-gitg_lane_new_with_color(GitgColor *color)
+guint8 const *
+gitg_lane_row_first(guint8 const *row)
 {
-	GitgLane *lane = g_slice_new0(GitgLane);
-	lane->color = color ? gitg_color_ref(color) : gitg_color_next();
-	
-	return lane;
+	return row ? row + 1 : NULL;
 }
 
-GitgLaneBoundary *
-gitg_lane_convert_boundary(GitgLane *lane, GitgLaneType type)
+gsize
+gitg_lane_row_size(guint8 const *row)
+{
+	guint num = gitg_lane_row_length(row);
+	guint8 const *ptr = gitg_lane_row_first(row);
+	guint i;
+
+	if (!row)
+		return 0;
+
+	for (i = 0; i < num; ++i)
+	{
+		gint8 type = (gint8)ptr[0];
+
+		ptr += 6 + ptr[5];
+
+		if (type & GITG_LANE_TYPE_START || type & GITG_LANE_TYPE_END)
+			ptr += sizeof(Hash);
+	}
+
+	return ptr - row;
+}
+
+gboolean
+gitg_lane_row_nth(guint8 const *row, guint n, GitgLane *lane)
+{
+	guint i;
+
+	if (n >= gitg_lane_row_length(row))
+		return FALSE;
+
+	row = gitg_lane_row_first(row);
+
+	for (i = 0; i <= n; ++i)
+		row = gitg_lane_unpack(row, lane);
+
+	return TRUE;
+}
+
+static void
+color_table_unref(ColorTable *table)
+{
+	if (!g_atomic_int_dec_and_test(&table->ref_count))
+		return;
+
+	g_free(table->colors);
+	g_slice_free(ColorTable, table);
+}
+
+/* GitgLaneArena functions */
+GitgLaneArena *
+gitg_lane_arena_new(GitgLaneArena *share)
+{
+	GitgLaneArena *arena = g_slice_new0(GitgLaneArena);
+	arena->ref_count = 1;
+
+	if (share)
+	{
+		arena->colors = share->colors;
+		g_atomic_int_inc(&arena->colors->ref_count);
+	}
+	else
+	{
+		arena->colors = g_slice_new0(ColorTable);
+		arena->colors->ref_count = 1;
+	}
+
+	return arena;
+}
+
+GitgLaneArena *
+gitg_lane_arena_ref(GitgLaneArena *arena)
+{
+	if (arena == NULL)
+		return NULL;
+
+	g_atomic_int_inc(&arena->ref_count);
+	return arena;
+}
+
+void
+gitg_lane_arena_unref(GitgLaneArena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	if (!g_atomic_int_dec_and_test(&arena->ref_count))
+		return;
+
+	g_slist_foreach(arena->chunks, (GFunc)g_free, NULL);
+	g_slist_free(arena->chunks);
+	color_table_unref(arena->colors);
+
+	g_slice_free(GitgLaneArena, arena);
+}
+
+guint8 *
+gitg_lane_arena_alloc(GitgLaneArena *arena, gsize size)
+{
+	guint8 *ret;
+
+	if (size > arena->left)
+	{
+		gsize chunk = MAX(size, ARENA_CHUNK_SIZE);
+
+		arena->current = g_malloc(chunk);
+		arena->left = chunk;
+		arena->chunks = g_slist_prepend(arena->chunks, arena->current);
+	}
+
+	ret = arena->current;
+	arena->current += size;
+	arena->left -= size;
+
+	return ret;
+}
+
+guint8 const *
+gitg_lane_arena_pack_row(GitgLaneArena *arena, GitgLane const *lanes, guint num)
+{
+	static gboolean warned = FALSE;
+	gsize size = 1;
+	guint i;
+
+	if (num > GITG_LANE_MAX_LANES)
+	{
+		if (!warned)
+			g_warning("Rows of more than %d lanes are cut", GITG_LANE_MAX_LANES);
+
+		warned = TRUE;
+		num = GITG_LANE_MAX_LANES;
+	}
+
+	for (i = 0; i < num; ++i)
+		size += gitg_lane_packed_size(&lanes[i]);
+
+	guint8 *row = gitg_lane_arena_alloc(arena, size);
+	guint8 *ptr = row;
+
+	*ptr++ = num;
+
+	for (i = 0; i < num; ++i)
+		ptr = gitg_lane_pack(&lanes[i], ptr);
+
+	return row;
+}
+
+guint8 const *
+gitg_lane_arena_copy_row(GitgLaneArena *arena, guint8 const *row)
+{
+	gsize size = gitg_lane_row_size(row);
+
+	if (!row)
+		return NULL;
+
+	guint8 *copy = gitg_lane_arena_alloc(arena, size);
+	memcpy(copy, row, size);
+
+	return copy;
+}
+
+guint32
+gitg_lane_arena_add_color(GitgLaneArena *arena, gint8 index)
+{
+	ColorTable *table = arena->colors;
+
+	if (table->num == table->allocated)
+	{
+		table->allocated = MAX(table->allocated * 2, 1024);
+		table->colors = g_renew(gint8, table->colors, table->allocated);
+	}
+
+	table->colors[table->num] = index;
+	return table->num++;
+}
+
+guint32
+gitg_lane_arena_num_colors(GitgLaneArena *arena)
+{
+	return arena->colors->num;
+}
+
+gint8
+gitg_lane_arena_get_color(GitgLaneArena *arena, guint32 color)
+{
+	g_return_val_if_fail(color < arena->colors->num, 0);
+	return arena->colors->colors[color];
+}
+
+void
+gitg_lane_arena_set_color(GitgLaneArena *arena, guint32 color, gint8 index)
 {
-	GitgLaneBoundary *boundary = g_slice_new(GitgLaneBoundary);
-	
-	boundary->lane = *lane;
-	boundary->lane.type |= type;
-	
-	g_slice_free(GitgLane, lane);
-	
-	return boundary;
+	g_return_if_fail(color < arena->colors->num);
+	arena->colors->colors[color] = index;
 }
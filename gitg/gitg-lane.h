@@ -4,7 +4,13 @@
 #include <glib.h>
 #include "gitg-color.h"
 #include "gitg-types.h"
-#define GITG_IS_LANE_BOUNDARY(lane) (lane->type & GITG_LANE_TYPE_START || lane->type & GITG_LANE_TYPE_END)
+#define GITG_IS_LANE_BOUNDARY(lane) ((lane)->type & GITG_LANE_TYPE_START || (lane)->type & GITG_LANE_TYPE_END)
+
+/* Merges beyond GITG_LANE_MAX_FROM on a single lane are not drawn. Lane
+   indices are stored in a gint8, rows are cut at GITG_LANE_MAX_LANES
+   lanes. Both cases are warned about once */
+#define GITG_LANE_MAX_FROM 8
+#define GITG_LANE_MAX_LANES G_MAXINT8
 
 typedef enum
 {
@@ -12,28 +18,50 @@ typedef enum
 	GITG_LANE_TYPE_START = 1 << 0,
 	GITG_LANE_TYPE_END = 1 << 1,
 	GITG_LANE_SIGN_LEFT = 1 << 2,
-	GITG_LANE_SIGN_RIGHT = 1 << 3
+	GITG_LANE_SIGN_RIGHT = 1 << 3,
+	GITG_LANE_TYPE_OVERFLOW = 1 << 4
 } GitgLaneType;
 
 typedef struct
 {
-	GitgColor *color; /** Pointer to color */
-	GSList *from; /** List of lanes merging on this lane */
+	guint32 color; /** Color in the color table of the lane arena */
 	gint8 type;
+	guint8 num_from;
+	gint8 from[GITG_LANE_MAX_FROM]; /** Lanes merging on this lane */
+	gchar const *hash; /** Revision hash of a START or END boundary */
 } GitgLane;
 
-typedef struct
-{
-	GitgLane lane;
-	Hash hash;
-} GitgLaneBoundary;
+/* Lane rows are stored packed in an arena: one byte holding the number of
+   lanes, followed by every lane as type, color (4 bytes), number of merges,
+   the merge indices and, for boundaries, the 20 byte hash. The arena also
+   holds the color table, so lanes that share a color can be recolored after
+   they have been packed. Arenas created to share the color table of another
+   arena can be freed independently */
+typedef struct _GitgLaneArena GitgLaneArena;
+
+void gitg_lane_init(GitgLane *lane, guint32 color);
+void gitg_lane_add_from(GitgLane *lane, gint8 from);
+
+gsize gitg_lane_packed_size(GitgLane const *lane);
+guint8 *gitg_lane_pack(GitgLane const *lane, guint8 *ptr);
+guint8 const *gitg_lane_unpack(guint8 const *ptr, GitgLane *lane);
+
+guint gitg_lane_row_length(guint8 const *row);
+gsize gitg_lane_row_size(guint8 const *row);
+guint8 const *gitg_lane_row_first(guint8 const *row);
+gboolean gitg_lane_row_nth(guint8 const *row, guint n, GitgLane *lane);
+
+GitgLaneArena *gitg_lane_arena_new(GitgLaneArena *share);
+GitgLaneArena *gitg_lane_arena_ref(GitgLaneArena *arena);
+void gitg_lane_arena_unref(GitgLaneArena *arena);
 
-GitgLane *gitg_lane_new();
-GitgLane *gitg_lane_new_with_color(GitgColor *color);
-GitgLane *gitg_lane_copy(GitgLane *lane);
-GitgLane *gitg_lane_dup(GitgLane *lane);
+guint8 *gitg_lane_arena_alloc(GitgLaneArena *arena, gsize size);
+guint8 const *gitg_lane_arena_pack_row(GitgLaneArena *arena, GitgLane const *lanes, guint num);
+guint8 const *gitg_lane_arena_copy_row(GitgLaneArena *arena, guint8 const *row);
 
-void gitg_lane_free(GitgLane *lane);
-GitgLaneBoundary *gitg_lane_convert_boundary(GitgLane *lane, GitgLaneType type);
+guint32 gitg_lane_arena_add_color(GitgLaneArena *arena, gint8 index);
+guint32 gitg_lane_arena_num_colors(GitgLaneArena *arena);
+gint8 gitg_lane_arena_get_color(GitgLaneArena *arena, guint32 color);
+void gitg_lane_arena_set_color(GitgLaneArena *arena, guint32 color, gint8 index);
 
 #endif /* __GITG_LANE_H__ */
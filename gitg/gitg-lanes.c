@@ -8,35 +8,128 @@
 #define INACTIVE_COLLAPSE 10
 #define INACTIVE_GAP 10
 
+/* the layout state is saved every CHECKPOINT_INTERVAL rows, and only the
+   rows of the MAX_RESIDENT_PAGES most recently used pages are kept */
+#define CHECKPOINT_INTERVAL 1000
+#define MAX_RESIDENT_PAGES 32
+
 typedef struct
 {
-	GitgLane *lane;
+	GitgLane lane;
 	guint8 inactive;
+	gint8 index;
 	gchar const *from;
 	gchar const *to;
 } LaneContainer;
 
 typedef struct 
 {
-	GitgColor *color;
+	guint32 color;
 	gint8 index;
 	gchar const *from;
 	gchar const *to;
 } CollapsedLane;
 
+/* a laid out row that can still change when lanes collapse or expand,
+   holding a reference on the arena row is packed in */
+typedef struct
+{
+	GitgRevision *revision;
+	guint8 const *row;
+	GitgLaneArena *arena;
+	gint8 mylane;
+	guint index;
+} PreviousRow;
+
+/* layout state before the first row of a page */
+typedef struct
+{
+	LaneContainer *lanes;
+	guint num_lanes;
+	
+	GSList *collapsed;
+	
+	/* most recent first, rows are copied in the checkpoint arena */
+	PreviousRow *previous;
+	guint num_previous;
+	
+	gint8 color_index;
+	guint32 num_colors;
+	guint position;
+} Checkpoint;
+
+typedef struct
+{
+	Checkpoint *checkpoint;
+	
+	/* rows of the page, NULL when they have been dropped */
+	GitgLaneArena *arena;
+	GList *link;
+} Page;
+
 struct _GitgLanesPrivate
 {
-	/* list of last N GitgRevisions used to backtrack in case of lane 
-	   collapse/reactivation */
-	GSList *previous;
+	/* ring buffer of the last N rows used to backtrack in case of lane
+	   collapse/reactivation, previous_head is the most recent one */
+	PreviousRow *previous;
+	guint previous_size;
+	guint previous_head;
+	guint num_previous;
 	
-	/* list of LaneContainer resembling the current lanes state for the 
+	/* layout settings */
+	guint inactive_max;
+	guint inactive_collapse;
+	guint inactive_gap;
+	guint max_lanes;
+	
+	/* array of LaneContainer resembling the current lanes state for the 
 	   next revision */
-	GSList *lanes;
+	GPtrArray *lanes;
+	
+	/* hash table of rev hash -> LaneContainer waiting for that revision */
+	GHashTable *index;
 	
 	/* hash table of rev hash -> CollapsedLane where rev hash is the hash
 	   to be expected on the lane */
 	GHashTable *collapsed;
+	
+	/* arena rows are currently packed in */
+	GitgLaneArena *arena;
+	
+	/* color table shared by all pages, also holds checkpoint rows */
+	GitgLaneArena *root;
+	gint8 color_index;
+	
+	/* scratch rows of GitgLane used when changing previous rows and when
+	   folding rows wider than max_lanes */
+	GArray *row;
+	GArray *folded;
+	
+	/* index of the next row laid out */
+	guint position;
+	
+	/* rows up to frontier have been laid out once */
+	guint frontier;
+	GPtrArray *pages;
+	GQueue *resident;
+	
+	/* when replaying a page, only rows in [emit_from, emit_to) are stored
+	   and colors are given the ids of the first layout */
+	gboolean replay;
+	guint emit_from;
+	guint emit_to;
+	guint32 replay_color;
+};
+
+/* Properties */
+enum
+{
+	PROP_0,
+	
+	PROP_INACTIVE_MAX,
+	PROP_INACTIVE_COLLAPSE,
+	PROP_INACTIVE_GAP,
+	PROP_MAX_LANES
 };
 
 G_DEFINE_TYPE(GitgLanes, gitg_lanes, G_TYPE_OBJECT)
@@ -44,14 +137,12 @@ G_DEFINE_TYPE(GitgLanes, gitg_lanes, G_TYPE_OBJECT)
 static void
 lane_container_free(LaneContainer *container)
 {
-	gitg_lane_free(container->lane);
 	g_slice_free(LaneContainer, container);
 }
 
 static void
 collapsed_lane_free(CollapsedLane *lane)
 {
-	gitg_color_unref(lane->color);
 	g_slice_free(CollapsedLane, lane);
 }
 
@@ -59,7 +150,7 @@ static CollapsedLane *
 collapsed_lane_new(LaneContainer *container)
 {
 	CollapsedLane *collapsed = g_slice_new(CollapsedLane);
-	collapsed->color = gitg_color_ref(container->lane->color);
+	collapsed->color = container->lane.color;
 	collapsed->from = container->from;
 	collapsed->to = container->to;
 	
@@ -69,37 +160,216 @@ collapsed_lane_new(LaneContainer *container)
 static void
 free_lanes(GitgLanes *lanes)
 {
-	g_slist_foreach(lanes->priv->lanes, (GFunc)lane_container_free, NULL);
-	g_slist_free(lanes->priv->lanes);
+	g_ptr_array_foreach(lanes->priv->lanes, (GFunc)lane_container_free, NULL);
+	g_ptr_array_set_size(lanes->priv->lanes, 0);
 	
-	lanes->priv->lanes = NULL;
+	g_hash_table_remove_all(lanes->priv->index);
 }
 
-static LaneContainer *
-find_lane_by_hash(GitgLanes *lanes, gchar const *hash, gint8 *pos)
+static PreviousRow *
+previous_nth(GitgLanes *lanes, guint n)
 {
-	GSList *item;
-	gint8 p = 0;
+	guint size = lanes->priv->previous_size;
+	return &lanes->priv->previous[(lanes->priv->previous_head + size - n) % size];
+}
 
-	if (!hash)
-		return NULL;
+static PreviousRow *
+previous_push(GitgLanes *lanes, PreviousRow const *row)
+{
+	guint head = (lanes->priv->previous_head + 1) % lanes->priv->previous_size;
+	PreviousRow *entry = &lanes->priv->previous[head];
+	
+	/* drop the oldest revision when the window is full */
+	if (lanes->priv->num_previous == lanes->priv->previous_size)
+	{
+		gitg_revision_unref(entry->revision);
+		gitg_lane_arena_unref(entry->arena);
+	}
+	else
+	{
+		++lanes->priv->num_previous;
+	}
 
-	for (item = lanes->priv->lanes; item; item = item->next)
+	*entry = *row;
+	gitg_revision_ref(entry->revision);
+	gitg_lane_arena_ref(entry->arena);
+	lanes->priv->previous_head = head;
+	
+	return entry;
+}
+
+static void
+previous_clear(GitgLanes *lanes)
+{
+	guint i;
+	
+	for (i = 0; i < lanes->priv->num_previous; ++i)
 	{
-		LaneContainer *container = (LaneContainer *)(item->data);
+		PreviousRow *entry = previous_nth(lanes, i);
+		
+		gitg_revision_unref(entry->revision);
+		gitg_lane_arena_unref(entry->arena);
+	}
+	
+	lanes->priv->num_previous = 0;
+	lanes->priv->previous_head = 0;
+}
 
-		if (container && container->to && gitg_utils_hash_equal(container->to, hash))
-		{
-			if (pos)
-				*pos = p;
+static void
+add_folded_from(GitgLane *lane, gint8 from, gint8 last)
+{
+	guint i;
+	
+	if (from > last)
+		from = last;
+	
+	for (i = 0; i < lane->num_from; ++i)
+	{
+		if (lane->from[i] == from)
+			return;
+	}
+	
+	gitg_lane_add_from(lane, from);
+}
+
+static guint8 const *
+fold_row(GitgLanes *lanes, guint8 const *row, gint8 *mylane)
+{
+	/* lanes from max_lanes - 1 onwards are drawn as a single overflow lane */
+	GArray *folded = lanes->priv->folded;
+	gint8 last = lanes->priv->max_lanes - 1;
+	guint num = gitg_lane_row_length(row);
+	guint8 const *ptr = gitg_lane_row_first(row);
+	guint i;
+	guint j;
+	
+	g_array_set_size(folded, last + 1);
+	
+	for (i = 0; i < num; ++i)
+	{
+		GitgLane lane;
+		GitgLane *target = &g_array_index(folded, GitgLane, MIN(i, last));
+		
+		ptr = gitg_lane_unpack(ptr, &lane);
 		
-			return container;
+		if (i < last)
+		{
+			*target = lane;
+			target->num_from = 0;
 		}
+		else if (i == last)
+		{
+			gitg_lane_init(target, lane.color);
+			target->type = GITG_LANE_TYPE_OVERFLOW;
+		}
+		
+		for (j = 0; j < lane.num_from; ++j)
+			add_folded_from(target, lane.from[j], last);
+	}
+	
+	if (*mylane > last)
+		*mylane = last;
+
+	return gitg_lane_arena_pack_row(lanes->priv->arena, (GitgLane *)folded->data, folded->len);
+}
+
+static void
+emit_row(GitgLanes *lanes, PreviousRow *entry)
+{
+	if (lanes->priv->replay && (entry->index < lanes->priv->emit_from || entry->index >= lanes->priv->emit_to))
+		return;
+	
+	guint8 const *row = entry->row;
+	gint8 mylane = entry->mylane;
+	
+	if (lanes->priv->max_lanes && gitg_lane_row_length(row) > lanes->priv->max_lanes)
+		row = fold_row(lanes, row, &mylane);
+	
+	gitg_revision_set_lanes(entry->revision, lanes->priv->arena, row, mylane);
+}
+
+static LaneContainer *
+lane_at(GitgLanes *lanes, gint8 index)
+{
+	if (index < 0 || index >= lanes->priv->lanes->len)
+		return NULL;
+
+	return (LaneContainer *)g_ptr_array_index(lanes->priv->lanes, index);
+}
 
-		++p;
+static void
+renumber_lanes(GitgLanes *lanes, guint from)
+{
+	guint i;
+	
+	for (i = from; i < lanes->priv->lanes->len; ++i)
+		lane_at(lanes, i)->index = i;
+}
+
+static void
+set_lane_to(GitgLanes *lanes, LaneContainer *container, gchar const *to)
+{
+	/* a hash is only ever expected on one lane, but keep the leftmost
+	   one indexed if that would not hold */
+	if (container->to && g_hash_table_lookup(lanes->priv->index, container->to) == container)
+		g_hash_table_remove(lanes->priv->index, container->to);
+	
+	container->to = to;
+	
+	if (to)
+	{
+		LaneContainer *other = (LaneContainer *)g_hash_table_lookup(lanes->priv->index, to);
+		
+		if (!other || other->index > container->index)
+			g_hash_table_insert(lanes->priv->index, (gpointer)to, container);
 	}
+}
+
+static void
+append_lane(GitgLanes *lanes, LaneContainer *container)
+{
+	container->index = lanes->priv->lanes->len;
+	g_ptr_array_add(lanes->priv->lanes, container);
+	
+	set_lane_to(lanes, container, container->to);
+}
+
+static void
+insert_lane(GitgLanes *lanes, LaneContainer *container, gint8 index)
+{
+	GPtrArray *array = lanes->priv->lanes;
+	
+	g_ptr_array_add(array, NULL);
+	memmove(array->pdata + index + 1, array->pdata + index, (array->len - index - 1) * sizeof(gpointer));
+	array->pdata[index] = container;
+	
+	renumber_lanes(lanes, index);
+	set_lane_to(lanes, container, container->to);
+}
+
+static void
+remove_lane(GitgLanes *lanes, LaneContainer *container)
+{
+	gint8 index = container->index;
+
+	set_lane_to(lanes, container, NULL);
+	g_ptr_array_remove_index(lanes->priv->lanes, index);
+	
+	renumber_lanes(lanes, index);
+}
+
+static LaneContainer *
+find_lane_by_hash(GitgLanes *lanes, gchar const *hash, gint8 *pos)
+{
+	if (!hash)
+		return NULL;
 	
-	return NULL;
+	LaneContainer *container = (LaneContainer *)g_hash_table_lookup(lanes->priv->index, hash);
+	
+	if (container && pos)
+		*pos = container->index;
+	
+	return container;
 }
 
 /* GitgLanes functions */
@@ -110,16 +380,115 @@ gitg_lanes_finalize(GObject *object)
 	
 	gitg_lanes_reset(self);
 	g_hash_table_destroy(self->priv->collapsed);
+	g_hash_table_destroy(self->priv->index);
+	g_ptr_array_free(self->priv->lanes, TRUE);
+	g_array_free(self->priv->row, TRUE);
+	g_array_free(self->priv->folded, TRUE);
+	g_free(self->priv->previous);
+	g_ptr_array_free(self->priv->pages, TRUE);
+	g_queue_free(self->priv->resident);
+	gitg_lane_arena_unref(self->priv->root);
 	
 	G_OBJECT_CLASS(gitg_lanes_parent_class)->finalize(object);
 }
 
+static void
+gitg_lanes_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GitgLanes *self = GITG_LANES(object);
+	
+	switch (prop_id)
+	{
+		case PROP_INACTIVE_MAX:
+			self->priv->inactive_max = g_value_get_uint(value);
+		break;
+		case PROP_INACTIVE_COLLAPSE:
+			self->priv->inactive_collapse = g_value_get_uint(value);
+		break;
+		case PROP_INACTIVE_GAP:
+			self->priv->inactive_gap = g_value_get_uint(value);
+		break;
+		case PROP_MAX_LANES:
+			self->priv->max_lanes = g_value_get_uint(value);
+		break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			return;
+	}
+	
+	/* rows laid out with the old settings are laid out again */
+	gitg_lanes_reset(self);
+}
+
+static void
+gitg_lanes_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GitgLanes *self = GITG_LANES(object);
+	
+	switch (prop_id)
+	{
+		case PROP_INACTIVE_MAX:
+			g_value_set_uint(value, self->priv->inactive_max);
+		break;
+		case PROP_INACTIVE_COLLAPSE:
+			g_value_set_uint(value, self->priv->inactive_collapse);
+		break;
+		case PROP_INACTIVE_GAP:
+			g_value_set_uint(value, self->priv->inactive_gap);
+		break;
+		case PROP_MAX_LANES:
+			g_value_set_uint(value, self->priv->max_lanes);
+		break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
 static void
 gitg_lanes_class_init(GitgLanesClass *klass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS(klass);
 	
 	object_class->finalize = gitg_lanes_finalize;
+	object_class->set_property = gitg_lanes_set_property;
+	object_class->get_property = gitg_lanes_get_property;
+	
+	g_object_class_install_property(object_class, PROP_INACTIVE_MAX,
+						 g_param_spec_uint ("inactive-max",
+								      "INACTIVE_MAX",
+								      "Number of rows a lane can be inactive before it collapses",
+								      1,
+								      200,
+								      INACTIVE_MAX,
+								      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+	
+	g_object_class_install_property(object_class, PROP_INACTIVE_COLLAPSE,
+						 g_param_spec_uint ("inactive-collapse",
+								      "INACTIVE_COLLAPSE",
+								      "Number of rows shown around a collapsed lane",
+								      1,
+								      50,
+								      INACTIVE_COLLAPSE,
+								      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+	
+	g_object_class_install_property(object_class, PROP_INACTIVE_GAP,
+						 g_param_spec_uint ("inactive-gap",
+								      "INACTIVE_GAP",
+								      "Number of rows to backtrack before collapsing a lane",
+								      0,
+								      50,
+								      INACTIVE_GAP,
+								      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+	
+	g_object_class_install_property(object_class, PROP_MAX_LANES,
+						 g_param_spec_uint ("max-lanes",
+								      "MAX_LANES",
+								      "Maximum number of lanes drawn, 0 for no maximum",
+								      0,
+								      G_MAXINT8,
+								      0,
+								      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
 	
 	g_type_class_add_private(object_class, sizeof(GitgLanesPrivate));
 }
@@ -129,6 +498,13 @@ gitg_lanes_init(GitgLanes *self)
 {
 	self->priv = GITG_LANES_GET_PRIVATE(self);
 	self->priv->collapsed = g_hash_table_new_full(gitg_utils_hash_hash, gitg_utils_hash_equal, NULL, (GDestroyNotify)collapsed_lane_free);
+	self->priv->index = g_hash_table_new(gitg_utils_hash_hash, gitg_utils_hash_equal);
+	self->priv->lanes = g_ptr_array_new();
+	self->priv->row = g_array_new(FALSE, FALSE, sizeof(GitgLane));
+	self->priv->folded = g_array_new(FALSE, FALSE, sizeof(GitgLane));
+	self->priv->pages = g_ptr_array_new();
+	self->priv->resident = g_queue_new();
+	self->priv->root = gitg_lane_arena_new(NULL);
 }
 
 GitgLanes *
@@ -137,90 +513,288 @@ gitg_lanes_new()
 	return GITG_LANES(g_object_new(GITG_TYPE_LANES, NULL));
 }
 
+static void
+set_arena(GitgLanes *lanes, GitgLaneArena *arena)
+{
+	gitg_lane_arena_ref(arena);
+	gitg_lane_arena_unref(lanes->priv->arena);
+	
+	lanes->priv->arena = arena;
+}
+
+static gint8
+palette_next(GitgLanes *lanes)
+{
+	gint8 index = lanes->priv->color_index;
+	
+	lanes->priv->color_index = gitg_color_next_index(index);
+	return index;
+}
+
+static guint32
+color_add(GitgLanes *lanes, gint8 index)
+{
+	/* replaying allocates colors in the same order as the first layout */
+	if (lanes->priv->replay)
+		return lanes->priv->replay_color++;
+
+	return gitg_lane_arena_add_color(lanes->priv->root, index);
+}
+
+static guint32
+color_next(GitgLanes *lanes)
+{
+	return color_add(lanes, palette_next(lanes));
+}
+
+static guint32
+color_copy(GitgLanes *lanes, guint32 color)
+{
+	return color_add(lanes, gitg_lane_arena_get_color(lanes->priv->root, color));
+}
+
+static void
+color_change(GitgLanes *lanes, guint32 color)
+{
+	gint8 index = palette_next(lanes);
+	
+	if (!lanes->priv->replay)
+		gitg_lane_arena_set_color(lanes->priv->root, color, index);
+}
+
 static LaneContainer *
-lane_container_new_with_color(gchar const *from, gchar const *to, GitgColor *color)
+lane_container_new_with_color(gchar const *from, gchar const *to, guint32 color)
 {
 	LaneContainer *ret = g_slice_new(LaneContainer);
 
 	ret->from = from;
 	ret->to = to;
-	ret->lane = gitg_lane_new_with_color(color);
 	ret->inactive = 0;
+	ret->index = -1;
 
+	gitg_lane_init(&ret->lane, color);
 	return ret;
 }
 
 static LaneContainer *
-lane_container_new(gchar const *from, gchar const *to)
+lane_container_new(GitgLanes *lanes, gchar const *from, gchar const *to)
+{
+	return lane_container_new_with_color(from, to, color_next(lanes));
+}
+
+static guint8 const *
+pack_lanes(GitgLanes *lanes)
+{
+	gsize size = 1;
+	guint i;
+	
+	for (i = 0; i < lanes->priv->lanes->len; ++i)
+		size += gitg_lane_packed_size(&lane_at(lanes, i)->lane);
+	
+	guint8 *row = gitg_lane_arena_alloc(lanes->priv->arena, size);
+	guint8 *ptr = row;
+	
+	*ptr++ = lanes->priv->lanes->len;
+	
+	for (i = 0; i < lanes->priv->lanes->len; ++i)
+		ptr = gitg_lane_pack(&lane_at(lanes, i)->lane, ptr);
+	
+	return row;
+}
+
+static GArray *
+unpack_row(GitgLanes *lanes, PreviousRow *entry)
+{
+	GArray *row = lanes->priv->row;
+	guint8 const *packed = entry->row;
+	guint num = gitg_lane_row_length(packed);
+	guint i;
+	
+	g_array_set_size(row, num);
+	packed = gitg_lane_row_first(packed);
+	
+	for (i = 0; i < num; ++i)
+		packed = gitg_lane_unpack(packed, &g_array_index(row, GitgLane, i));
+	
+	return row;
+}
+
+static void
+repack_row(GitgLanes *lanes, PreviousRow *entry, GArray *row)
+{
+	/* the previous encoding of the row stays unused in its arena */
+	entry->row = gitg_lane_arena_pack_row(lanes->priv->arena, (GitgLane *)row->data, row->len);
+	
+	gitg_lane_arena_ref(lanes->priv->arena);
+	gitg_lane_arena_unref(entry->arena);
+	entry->arena = lanes->priv->arena;
+	emit_row(lanes, entry);
+}
+
+static void
+save_collapsed(gpointer key, CollapsedLane *lane, GSList **list)
 {
-	return lane_container_new_with_color(from, to, NULL);
+	*list = g_slist_prepend(*list, g_slice_dup(CollapsedLane, lane));
 }
 
-GSList *
-lanes_list(GitgLanes *lanes)
+/* Rows of the previous rows window are copied in the root arena, unless
+   copy is FALSE in which case the checkpoint keeps the arenas of the rows
+   alive */
+static Checkpoint *
+checkpoint_new(GitgLanes *lanes, gboolean copy)
+{
+	Checkpoint *checkpoint = g_slice_new0(Checkpoint);
+	guint i;
+	
+	checkpoint->num_lanes = lanes->priv->lanes->len;
+	checkpoint->lanes = g_new(LaneContainer, checkpoint->num_lanes);
+	
+	for (i = 0; i < checkpoint->num_lanes; ++i)
+		checkpoint->lanes[i] = *lane_at(lanes, i);
+	
+	g_hash_table_foreach(lanes->priv->collapsed, (GHFunc)save_collapsed, &checkpoint->collapsed);
+	
+	checkpoint->num_previous = lanes->priv->num_previous;
+	checkpoint->previous = g_new(PreviousRow, checkpoint->num_previous);
+	
+	for (i = 0; i < checkpoint->num_previous; ++i)
+	{
+		PreviousRow *entry = &checkpoint->previous[i];
+		
+		*entry = *previous_nth(lanes, i);
+		gitg_revision_ref(entry->revision);
+		
+		if (copy)
+		{
+			entry->row = gitg_lane_arena_copy_row(lanes->priv->root, entry->row);
+			entry->arena = lanes->priv->root;
+		}
+		
+		gitg_lane_arena_ref(entry->arena);
+	}
+	
+	checkpoint->color_index = lanes->priv->color_index;
+	checkpoint->num_colors = gitg_lane_arena_num_colors(lanes->priv->root);
+	checkpoint->position = lanes->priv->position;
+	
+	return checkpoint;
+}
+
+static void
+checkpoint_free(Checkpoint *checkpoint)
+{
+	guint i;
+	
+	for (i = 0; i < checkpoint->num_previous; ++i)
+	{
+		gitg_revision_unref(checkpoint->previous[i].revision);
+		gitg_lane_arena_unref(checkpoint->previous[i].arena);
+	}
+	
+	g_slist_foreach(checkpoint->collapsed, (GFunc)collapsed_lane_free, NULL);
+	g_slist_free(checkpoint->collapsed);
+	g_free(checkpoint->previous);
+	g_free(checkpoint->lanes);
+	
+	g_slice_free(Checkpoint, checkpoint);
+}
+
+static void
+checkpoint_restore(GitgLanes *lanes, Checkpoint *checkpoint)
 {
-	GSList *lns = NULL;
 	GSList *item;
+	guint i;
+	
+	free_lanes(lanes);
+	
+	for (i = 0; i < checkpoint->num_lanes; ++i)
+		append_lane(lanes, g_slice_dup(LaneContainer, &checkpoint->lanes[i]));
+	
+	g_hash_table_remove_all(lanes->priv->collapsed);
+	
+	for (item = checkpoint->collapsed; item; item = item->next)
+	{
+		CollapsedLane *collapsed = g_slice_dup(CollapsedLane, item->data);
+		g_hash_table_insert(lanes->priv->collapsed, (gpointer)collapsed->to, collapsed);
+	}
 	
-	for (item = lanes->priv->lanes; item; item = item->next)
-		lns = g_slist_prepend(lns, gitg_lane_copy(((LaneContainer*)item->data)->lane));
+	previous_clear(lanes);
 	
-	return g_slist_reverse(lns);
+	for (i = checkpoint->num_previous; i > 0; --i)
+		previous_push(lanes, &checkpoint->previous[i - 1]);
+	
+	lanes->priv->color_index = checkpoint->color_index;
+	lanes->priv->replay_color = checkpoint->num_colors;
+	lanes->priv->position = checkpoint->position;
+}
+
+static void
+page_free(Page *page)
+{
+	checkpoint_free(page->checkpoint);
+	gitg_lane_arena_unref(page->arena);
+
+	g_slice_free(Page, page);
 }
 
 void
 gitg_lanes_reset(GitgLanes *lanes)
 {
 	free_lanes(lanes);
-	gitg_color_reset();
+	previous_clear(lanes);
+	g_hash_table_remove_all(lanes->priv->collapsed);
 	
-	g_slist_foreach(lanes->priv->previous, (GFunc)gitg_revision_unref, NULL);
-	g_slist_free(lanes->priv->previous);
-	lanes->priv->previous = NULL;
+	/* the window covers the rows changed when collapsing a lane */
+	lanes->priv->previous_size = lanes->priv->inactive_collapse + lanes->priv->inactive_gap + 1;
+	lanes->priv->previous = g_renew(PreviousRow, lanes->priv->previous, lanes->priv->previous_size);
 	
-	g_hash_table_remove_all(lanes->priv->collapsed);
+	/* rows of the previous layout keep their arenas alive */
+	g_ptr_array_foreach(lanes->priv->pages, (GFunc)page_free, NULL);
+	g_ptr_array_set_size(lanes->priv->pages, 0);
+	
+	while (!g_queue_is_empty(lanes->priv->resident))
+		g_queue_pop_head(lanes->priv->resident);
+
+	set_arena(lanes, NULL);
+	gitg_lane_arena_unref(lanes->priv->root);
+	lanes->priv->root = gitg_lane_arena_new(NULL);
+	
+	lanes->priv->color_index = 0;
+	lanes->priv->position = 0;
+	lanes->priv->frontier = 0;
+	lanes->priv->replay = FALSE;
 }
 
-static gboolean
+static void
 lane_container_next(LaneContainer *container, gint index)
 {
-	GitgLane *lane = gitg_lane_copy(container->lane);
-	lane->type = GITG_LANE_TYPE_NONE;
-	g_slist_free(lane->from);
-	
-	gitg_lane_free(container->lane);
-
-	container->lane = lane;
-	container->lane->from = g_slist_prepend(NULL, GINT_TO_POINTER((gint)(index)));
+	gitg_lane_init(&container->lane, container->lane.color);
+	gitg_lane_add_from(&container->lane, index);
 	
 	++container->inactive;
 }
 
 static void
-update_lane_merge_indices(GSList *from, gint8 index, gint direction)
+update_lane_merge_indices(GitgLane *lane, gint8 index, gint direction)
 {
-	GSList *item;
+	guint i;
 	
-	for (item = from; item; item = g_slist_next(item))
+	for (i = 0; i < lane->num_from; ++i)
 	{
-		gint8 idx = GPOINTER_TO_INT(item->data);
+		gint8 idx = lane->from[i];
 
 		if ((direction < 0 && idx > index) || (direction > 0 && idx >= index))
-			item->data = GINT_TO_POINTER(idx + direction);
+			lane->from[i] = idx + direction;
 	}
 }
 
 static void
-update_merge_indices(GSList *lanes, gint8 index, gint direction)
+update_merge_indices(GArray *row, gint8 index, gint direction)
 {
-	GSList *item;
+	guint i;
 	
-	for (item = lanes; item; item = g_slist_next(item))
-	{
-		GitgLane *lane = (GitgLane *)item->data;
-		
-		update_lane_merge_indices(lane->from, index, direction);
-	}
+	for (i = 0; i < row->len; ++i)
+		update_lane_merge_indices(&g_array_index(row, GitgLane, i), index, direction);
 }
 
 static void
@@ -235,48 +809,48 @@ add_collapsed(GitgLanes *lanes, LaneContainer *container, gint8 index)
 static void
 collapse_lane(GitgLanes *lanes, LaneContainer *container, gint8 index)
 {
-	/* backtrack for INACTIVE_COLLAPSE revisions and remove this container from
+	/* backtrack for inactive_collapse revisions and remove this container from
 	   those revisions, appropriately updating merge indices etc */
-	GSList *item;
+	guint i;
+	guint num = lanes->priv->num_previous;
 	
 	add_collapsed(lanes, container, index);
 	
-	for (item = lanes->priv->previous; item; item = g_slist_next(item))
+	for (i = 0; i < num; ++i)
 	{
-		GitgRevision *revision = GITG_REVISION(item->data);
-		GSList *lns = gitg_revision_get_lanes(revision);
-		gint8 newindex = index;
+		PreviousRow *entry = previous_nth(lanes, i);
+		GArray *row = unpack_row(lanes, entry);
+		
+		if (index < 0 || index >= row->len)
+			break;
+		
+		GitgLane *lane = &g_array_index(row, GitgLane, index);
 		
 		/* remove lane at 'index' and update merge indices for the lanes
 		   after 'index' in the list */
-		if (item->next)
+		if (i + 1 < num)
 		{
-			GSList *collapsed = g_slist_nth(lns, index);
-			GitgLane *lane = (GitgLane *)collapsed->data;
-			
-			gint8 newindex = GPOINTER_TO_INT(lane->from->data);
+			gint8 newindex = lane->num_from ? lane->from[0] : index;
 
-			lns = gitg_revision_remove_lane(revision, lane);
-			
-			if (item->next->next)
-				update_merge_indices(lns, newindex, -1);
+			g_array_remove_index(row, index);
 			
-			gint mylane = gitg_revision_get_mylane(revision);
+			if (i + 2 < num)
+				update_merge_indices(row, newindex, -1);
 			
-			if (mylane > index)
-				gitg_revision_set_mylane(revision, mylane - 1);
-	
+			if (entry->mylane > index)
+				--entry->mylane;
+
+			repack_row(lanes, entry, row);
 			index = newindex;
 		}
 		else
 		{
-			/* the last item we keep, and set the style of the lane to END */
-			GSList *lstlane = g_slist_nth(lns, index);
-			GitgLaneBoundary *boundary = gitg_lane_convert_boundary((GitgLane *)lstlane->data, GITG_LANE_TYPE_END);
+			/* the last item we keep, and set the style of the lane to END,
+			   the parent hash gets copied when packing */
+			lane->type |= GITG_LANE_TYPE_END;
+			lane->hash = container->to;
 			
-			/* copy parent hash over */
-			memcpy(boundary->hash, container->to, 20);
-			lstlane->data = boundary;
+			repack_row(lanes, entry, row);
 		}
 	}	
 }
@@ -284,45 +858,45 @@ collapse_lane(GitgLanes *lanes, LaneContainer *container, gint8 index)
 static void
 update_current_lanes_merge_indices(GitgLanes *lanes, gint8 index, gint8 direction)
 {
-	GSList *item;
+	guint i;
 	
-	for (item = lanes->priv->lanes; item; item = g_slist_next(item))
-		update_lane_merge_indices(((LaneContainer *)item->data)->lane->from, index, direction);
+	for (i = 0; i < lanes->priv->lanes->len; ++i)
+		update_lane_merge_indices(&lane_at(lanes, i)->lane, index, direction);
 }
 
 static void
 collapse_lanes(GitgLanes *lanes)
 {
-	GSList *item = lanes->priv->lanes;
 	gint8 index = 0;
+	
+	/* a lane only collapses when it is a passthrough for the whole window */
+	guint threshold = MAX(lanes->priv->inactive_max + lanes->priv->inactive_gap, lanes->priv->previous_size);
 
-	while (item)
+	while (index < lanes->priv->lanes->len)
 	{
-		LaneContainer *container = (LaneContainer *)item->data;
+		LaneContainer *container = lane_at(lanes, index);
+		
+		/* lanes over the budget collapse as soon as possible */
+		gboolean over = lanes->priv->max_lanes && lanes->priv->lanes->len > lanes->priv->max_lanes && index >= lanes->priv->max_lanes - 1;
 		
-		if (container->inactive != INACTIVE_MAX + INACTIVE_GAP)
+		if (container->inactive < (over ? lanes->priv->previous_size : threshold))
 		{
-			item = g_slist_next(item);
 			++index;
 			continue;
 		}
 
-		collapse_lane(lanes, container, GPOINTER_TO_INT(container->lane->from->data));
+		collapse_lane(lanes, container, container->lane.from[0]);
 		update_current_lanes_merge_indices(lanes, index, -1);
 		
-		GSList *next = g_slist_next(item);
-
+		remove_lane(lanes, container);
 		lane_container_free(container);
-
-		lanes->priv->lanes = g_slist_remove_link(lanes->priv->lanes, item);
-		item = next;
 	}
 }
 
 static gint8
-ensure_correct_index(GitgRevision *revision, gint8 index)
+ensure_correct_index(PreviousRow *entry, gint8 index)
 {
-	guint len = g_slist_length(gitg_revision_get_lanes(revision));
+	guint len = gitg_lane_row_length(entry->row);
 	
 	if (index > len)
 		index = len;
@@ -333,66 +907,65 @@ ensure_correct_index(GitgRevision *revision, gint8 index)
 static void
 expand_lane(GitgLanes *lanes, CollapsedLane *lane)
 {
-	GSList *item;
 	gint8 index = lane->index;
 
-	GitgLane *ln = gitg_lane_new_with_color(lane->color);
-	guint len = g_slist_length(lanes->priv->lanes);
+	guint len = lanes->priv->lanes->len;
+	guint num = lanes->priv->num_previous;
 	gint8 next;
 	
 	if (index > len)
 		index = len;
 
-	next = ensure_correct_index((GitgRevision *)lanes->priv->previous->data, index);
+	next = ensure_correct_index(previous_nth(lanes, 0), index);
 	LaneContainer *container = lane_container_new_with_color(lane->from, lane->to, lane->color);
 
 	update_current_lanes_merge_indices(lanes, index, 1);
 
-	container->lane->from = g_slist_prepend(NULL, GINT_TO_POINTER((gint)next));
-	lanes->priv->lanes = g_slist_insert(lanes->priv->lanes, container, index);
+	gitg_lane_add_from(&container->lane, next);
+	insert_lane(lanes, container, index);
 
 	index = next;
-	guint cnt = 0;
+	guint cnt;
 	
-	for (item = lanes->priv->previous; item; item = g_slist_next(item))
+	for (cnt = 0; cnt < num; ++cnt)
 	{
-		GitgRevision *revision = GITG_REVISION(item->data);
+		PreviousRow *entry = previous_nth(lanes, cnt);
 
-		if (cnt == INACTIVE_COLLAPSE)
+		if (cnt == lanes->priv->inactive_collapse)
 			break;
 
 		/* insert new lane at the index */
-		GitgLane *copy = gitg_lane_copy(ln);
-		GSList *lns = gitg_revision_get_lanes(revision);
+		GitgLane copy;
+		GArray *row = unpack_row(lanes, entry);
+		
+		gitg_lane_init(&copy, lane->color);
 
-		if (!item->next || cnt + 1 == INACTIVE_COLLAPSE)
+		if (cnt + 1 == num || cnt + 1 == lanes->priv->inactive_collapse)
 		{
-			GitgLaneBoundary *boundary = gitg_lane_convert_boundary(copy, GITG_LANE_TYPE_START);
-			
-			/* copy child hash in boundary */
-			memcpy(boundary->hash, lane->from, 20);
-			copy = (GitgLane *)boundary;
+			/* child hash in boundary, copied when packing */
+			copy.type = GITG_LANE_TYPE_START;
+			copy.hash = lane->from;
 		}
 		else
 		{
-			next = ensure_correct_index(GITG_REVISION(item->next->data), index);
-			copy->from = g_slist_prepend(NULL, GINT_TO_POINTER((gint)next));
+			next = ensure_correct_index(previous_nth(lanes, cnt + 1), index);
+			gitg_lane_add_from(&copy, next);
 			
 			/* update merge indices */
-			update_merge_indices(lns, index, 1);
+			update_merge_indices(row, index, 1);
 		}
 
-		lns = gitg_revision_insert_lane(revision, copy, index);
-		gint mylane = gitg_revision_get_mylane(revision);
-		
-		if (mylane >= index)
-			gitg_revision_set_mylane(revision, mylane + 1);
+		if (index > row->len)
+			index = row->len;
+
+		g_array_insert_val(row, index, copy);
 		
+		if (entry->mylane >= index)
+			++entry->mylane;
+
+		repack_row(lanes, entry, row);
 		index = next;
-		++cnt;
 	}
-	
-	gitg_lane_free(ln);
 }
 
 static void
@@ -424,22 +997,17 @@ expand_lanes(GitgLanes *lanes, GitgRevision *revision)
 static void
 init_next_layer(GitgLanes *lanes)
 {
-	GSList *item = lanes->priv->lanes;
-	gint8 index = 0;
+	guint i;
 	
 	/* Initialize new set of lanes based on 'lanes'. It copies the lane (refs
 	   the color) and adds the lane index as a merge (so it basicly represents
 	   a passthrough) */
-	for (item = lanes->priv->lanes; item; item = g_slist_next(item))
-	{
-		LaneContainer *container = (LaneContainer *)item->data;
-
-		lane_container_next(container, index++);
-	}
+	for (i = 0; i < lanes->priv->lanes->len; ++i)
+		lane_container_next(lane_at(lanes, i), i);
 }
 
 static void
-prepare_lanes(GitgLanes *lanes, GitgRevision *next, gint8 *pos)
+prepare_lanes(GitgLanes *lanes, GitgRevision *next, gint8 *pos, guint8 const *packed)
 {
 	LaneContainer *mylane;
 	guint num;
@@ -450,7 +1018,7 @@ prepare_lanes(GitgLanes *lanes, GitgRevision *next, gint8 *pos)
 	/* prepare the next layer */
 	init_next_layer(lanes);
 	
-	mylane = (LaneContainer *)g_slist_nth_data(lanes->priv->lanes, *pos);
+	mylane = lane_at(lanes, *pos);
 	
 	/* Iterate over all parents and find them a lane */
 	for (i = 0; i < num; ++i)
@@ -463,8 +1031,8 @@ prepare_lanes(GitgLanes *lanes, GitgRevision *next, gint8 *pos)
 			/* There already is a lane for this parent. This means that we add
 			   mypos as a merge for the lane, also this means the color of 
 			   this lane incluis the merge should change to one color */
-			container->lane->from = g_slist_append(container->lane->from, GINT_TO_POINTER((gint)*pos));
-			gitg_color_next_index(container->lane->color);
+			gitg_lane_add_from(&container->lane, *pos);
+			color_change(lanes, container->lane.color);
 			container->inactive = 0;
 			container->from = gitg_revision_get_hash(next);
 			
@@ -474,82 +1042,182 @@ prepare_lanes(GitgLanes *lanes, GitgRevision *next, gint8 *pos)
 		{
 			/* There is no parent yet which can proceed on the current
 			   revision lane, so set it now */
-			mylane->to = (gchar const *)parents[i];
+			set_lane_to(lanes, mylane, (gchar const *)parents[i]);
 			
 			/* If there is more than one parent, then also change the color 
 			   since this revision is a merge */
 			if (num > 1)
-			{
-				gitg_color_unref(mylane->lane->color);
-				mylane->lane->color = gitg_color_next();
-			}
+				mylane->lane.color = color_next(lanes);
 			else
-			{
-				GitgColor *nc = gitg_color_copy(mylane->lane->color);
-				gitg_color_unref(mylane->lane->color);
-				mylane->lane->color = nc;
-			}
+				mylane->lane.color = color_copy(lanes, mylane->lane.color);
 		}
 		else
 		{
 			/* Generate a new lane for this parent */
-			LaneContainer *newlane = lane_container_new(myhash, parents[i]);
-			newlane->lane->from = g_slist_prepend(NULL, GINT_TO_POINTER((gint)*pos));
-			lanes->priv->lanes = g_slist_append(lanes->priv->lanes, newlane);
+			LaneContainer *newlane = lane_container_new(lanes, myhash, parents[i]);
+			gitg_lane_add_from(&newlane->lane, *pos);
+			append_lane(lanes, newlane);
 		}
 	}
 	
 	/* Remove the current lane if it is no longer needed */
 	if (mylane && mylane->to == NULL)
 	{
-		lanes->priv->lanes = g_slist_remove(lanes->priv->lanes, mylane);
+		remove_lane(lanes, mylane);
+		lane_container_free(mylane);
 	}
 
 	/* Store new revision in our track list */
-	if (g_slist_length(lanes->priv->previous) == INACTIVE_COLLAPSE + INACTIVE_GAP + 1)
-	{
-		GSList *last = g_slist_last(lanes->priv->previous);
-		gitg_revision_unref(GITG_REVISION(last->data));
-		
-		lanes->priv->previous = g_slist_remove_link(lanes->priv->previous, last);
-	}
-
-	lanes->priv->previous = g_slist_prepend(lanes->priv->previous, gitg_revision_ref(next));
+	PreviousRow entry = {next, packed, lanes->priv->arena, *pos, lanes->priv->position++};
+	emit_row(lanes, previous_push(lanes, &entry));
 }
 
-GSList *
-gitg_lanes_next(GitgLanes *lanes, GitgRevision *next, gint8 *nextpos)
+static void
+lanes_next(GitgLanes *lanes, GitgRevision *next)
 {
+	gint8 pos;
 	LaneContainer *mylane;
-	GSList *res;
 	gchar const *myhash = gitg_revision_get_hash(next);
 
 	collapse_lanes(lanes);
 	expand_lanes(lanes, next);
 
-	mylane = find_lane_by_hash(lanes, myhash, nextpos);
+	mylane = find_lane_by_hash(lanes, myhash, &pos);
 
 	if (!mylane)
 	{
 		/* apparently, there is no lane reserved for this revision, we
 		   add a new one */
-		lanes->priv->lanes = g_slist_append(lanes->priv->lanes, lane_container_new(myhash, NULL));
-		*nextpos = g_slist_length(lanes->priv->lanes) - 1;
+		append_lane(lanes, lane_container_new(lanes, myhash, NULL));
+		pos = lanes->priv->lanes->len - 1;
 	}
 	else
 	{
 		/* copy the color here because this represents a new stop */
-		GitgColor *nc = gitg_color_copy(mylane->lane->color);
-		gitg_color_unref(mylane->lane->color);
-
-		mylane->lane->color = nc;
-		mylane->to = NULL;
+		mylane->lane.color = color_copy(lanes, mylane->lane.color);
+		set_lane_to(lanes, mylane, NULL);
 		mylane->from = gitg_revision_get_hash(next);
 		mylane->inactive = 0;
 	}
 
-	res = lanes_list(lanes);
-	prepare_lanes(lanes, next, nextpos);
+	prepare_lanes(lanes, next, &pos, pack_lanes(lanes));
+}
+
+static void
+clear_page_rows(GitgLanes *lanes, GitgRevision **revisions, Page *page)
+{
+	guint start = page->checkpoint->position;
+	guint end = MIN(start + CHECKPOINT_INTERVAL, lanes->priv->frontier);
+	guint i;
+	
+	for (i = start; i < end; ++i)
+		gitg_revision_set_lanes(revisions[i], NULL, NULL, -1);
+}
+
+static void
+touch_page(GitgLanes *lanes, GitgRevision **revisions, Page *page)
+{
+	GQueue *resident = lanes->priv->resident;
+	
+	if (page->link)
+	{
+		g_queue_unlink(resident, page->link);
+		g_queue_push_head_link(resident, page->link);
+		return;
+	}
+	
+	g_queue_push_head(resident, page);
+	page->link = resident->head;
+	
+	/* drop the rows of the least recently used pages, they are laid out
+	   again from their checkpoint when needed */
+	while (resident->length > MAX_RESIDENT_PAGES)
+	{
+		Page *old = (Page *)g_queue_pop_tail(resident);
+		
+		clear_page_rows(lanes, revisions, old);
+		gitg_lane_arena_unref(old->arena);
+
+		old->arena = NULL;
+		old->link = NULL;
+	}
+}
+
+static void
+layout_next(GitgLanes *lanes, GitgRevision **revisions)
+{
+	guint frontier = lanes->priv->frontier;
+	
+	if (frontier % CHECKPOINT_INTERVAL == 0)
+	{
+		Page *page = g_slice_new0(Page);
+		
+		page->checkpoint = checkpoint_new(lanes, TRUE);
+		page->arena = gitg_lane_arena_new(lanes->priv->root);
+		g_ptr_array_add(lanes->priv->pages, page);
+		
+		set_arena(lanes, page->arena);
+		touch_page(lanes, revisions, page);
+	}
+	
+	lanes_next(lanes, revisions[frontier]);
+	++lanes->priv->frontier;
+}
+
+static void
+replay_page(GitgLanes *lanes, GitgRevision **revisions, Page *page)
+{
+	guint start = page->checkpoint->position;
+	guint end = MIN(start + CHECKPOINT_INTERVAL + lanes->priv->previous_size, lanes->priv->frontier);
+	guint i;
+	
+	/* save the state at the frontier to continue from later. Rows are
+	   packed anew rather than changed in place, so the rows of the window
+	   need no copy, the checkpoint keeps their arenas alive */
+	Checkpoint *current = checkpoint_new(lanes, FALSE);
+	GitgLaneArena *arena = gitg_lane_arena_ref(lanes->priv->arena);
+	
+	page->arena = gitg_lane_arena_new(lanes->priv->root);
+	set_arena(lanes, page->arena);
+	checkpoint_restore(lanes, page->checkpoint);
+	
+	/* rows after the page are laid out too since they can still change
+	   the last rows of the page */
+	lanes->priv->replay = TRUE;
+	lanes->priv->emit_from = start;
+	lanes->priv->emit_to = start + CHECKPOINT_INTERVAL;
+	
+	for (i = start; i < end; ++i)
+		lanes_next(lanes, revisions[i]);
+	
+	lanes->priv->replay = FALSE;
+	
+	checkpoint_restore(lanes, current);
+	checkpoint_free(current);
+
+	set_arena(lanes, arena);
+	gitg_lane_arena_unref(arena);
+}
+
+void
+gitg_lanes_ensure(GitgLanes *lanes, GitgRevision **revisions, guint num, guint row)
+{
+	g_return_if_fail(GITG_IS_LANES(lanes));
+	
+	if (row >= num)
+		return;
+	
+	/* a row is final once it left the window of rows which can still be
+	   changed by collapsing or expanding lanes */
+	guint target = MIN(row + lanes->priv->previous_size + 1, num);
+	
+	while (lanes->priv->frontier < target)
+		layout_next(lanes, revisions);
+	
+	Page *page = (Page *)g_ptr_array_index(lanes->priv->pages, row / CHECKPOINT_INTERVAL);
+	
+	if (!page->arena)
+		replay_page(lanes, revisions, page);
 
-	return res;
+	touch_page(lanes, revisions, page);
 }
@@ -33,7 +33,10 @@ GType gitg_lanes_get_type (void) G_GNUC_CONST;
 
 GitgLanes *gitg_lanes_new(void);
 void gitg_lanes_reset(GitgLanes *lanes);
-GSList *gitg_lanes_next(GitgLanes *lanes, GitgRevision *next, gint8 *mylane);
+
+/* make sure row of revisions has its final lanes, laying out the rows
+   before it when needed */
+void gitg_lanes_ensure(GitgLanes *lanes, GitgRevision **revisions, guint num, guint row);
 
 G_END_DECLS
 
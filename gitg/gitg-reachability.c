@@ -0,0 +1,391 @@
+#include "gitg-reachability.h"
+#include "gitg-utils.h"
+#include <string.h>
+
+/* Reachability keeps, for every loaded revision, a bitmask with one bit per
+   ref telling whether the revision can be reached from that ref. Revisions
+   are fed in log order from the main thread and processed on a worker
+   thread: the mask of a revision is the union of the masks of its children
+   (collected in 'pending' until the revision itself arrives) and the bits of
+   the refs pointing at it */
+
+/* the mutex is released after this many revisions, so the main thread
+   querying masks is not held up for a whole batch */
+#define LOCK_CHUNK 256
+
+typedef struct
+{
+	GitgRevision **revisions;
+	guint num;
+} Batch;
+
+struct _GitgReachability
+{
+	GThread *thread;
+	GAsyncQueue *queue;
+	GMutex *mutex;
+	volatile gint cancelled;
+
+	GitgReachabilityFunc func;
+	gpointer userdata;
+	guint idle_id;
+	guint notified;
+
+	/* refs, indexed by bit */
+	GitgRef **refs;
+	guint num_refs;
+	guint words;
+
+	/* hash -> mask of the refs pointing at hash */
+	GHashTable *tips;
+
+	/* only used by the worker */
+	GPtrArray *revisions;
+	GHashTable *index;
+	GHashTable *pending;
+	GArray *stack;
+
+	/* protected by mutex */
+	guint32 *masks;
+	guint allocated;
+	guint processed;
+};
+
+static Batch stop_batch = {NULL, 0};
+
+static gboolean
+mask_or(guint32 *dest, guint32 const *src, guint words)
+{
+	gboolean changed = FALSE;
+	guint i;
+
+	for (i = 0; i < words; ++i)
+	{
+		if (src[i] & ~dest[i])
+		{
+			dest[i] |= src[i];
+			changed = TRUE;
+		}
+	}
+
+	return changed;
+}
+
+static void
+ensure_masks(GitgReachability *reachability, guint size)
+{
+	if (size <= reachability->allocated)
+		return;
+
+	guint prev = reachability->allocated;
+	reachability->allocated = MAX(prev * 2, 1024);
+	reachability->masks = g_renew(guint32, reachability->masks, reachability->allocated * reachability->words);
+
+	memset(reachability->masks + prev * reachability->words, 0, (reachability->allocated - prev) * reachability->words * sizeof(guint32));
+}
+
+static void
+add_to_parents(GitgReachability *reachability, GitgRevision *revision, guint32 const *mask)
+{
+	guint num;
+	guint i;
+	Hash *parents = gitg_revision_get_parents_hash(revision, &num);
+
+	for (i = 0; i < num; ++i)
+	{
+		guint row = GPOINTER_TO_UINT(g_hash_table_lookup(reachability->index, parents[i]));
+
+		if (row)
+		{
+			/* parent was already seen (clock skew in the log order),
+			   propagate down from there */
+			--row;
+			g_array_append_val(reachability->stack, row);
+			continue;
+		}
+
+		guint32 *pending = (guint32 *)g_hash_table_lookup(reachability->pending, parents[i]);
+
+		if (!pending)
+		{
+			pending = g_new0(guint32, reachability->words);
+			g_hash_table_insert(reachability->pending, parents[i], pending);
+		}
+
+		mask_or(pending, mask, reachability->words);
+	}
+}
+
+static void
+propagate(GitgReachability *reachability, guint32 const *mask)
+{
+	GArray *stack = reachability->stack;
+
+	while (stack->len)
+	{
+		guint row = g_array_index(stack, guint, stack->len - 1);
+		g_array_set_size(stack, stack->len - 1);
+
+		if (!mask_or(reachability->masks + row * reachability->words, mask, reachability->words))
+			continue;
+
+		add_to_parents(reachability, GITG_REVISION(g_ptr_array_index(reachability->revisions, row)), mask);
+	}
+}
+
+static void
+process_revision(GitgReachability *reachability, GitgRevision *revision)
+{
+	guint row = reachability->revisions->len;
+	gchar const *hash = gitg_revision_get_hash(revision);
+
+	g_ptr_array_add(reachability->revisions, revision);
+	g_hash_table_insert(reachability->index, (gpointer)hash, GUINT_TO_POINTER(row + 1));
+
+	if (reachability->words == 0)
+		return;
+
+	ensure_masks(reachability, row + 1);
+	guint32 *mask = reachability->masks + row * reachability->words;
+
+	guint32 *pending = (guint32 *)g_hash_table_lookup(reachability->pending, hash);
+
+	if (pending)
+	{
+		mask_or(mask, pending, reachability->words);
+		g_hash_table_remove(reachability->pending, hash);
+	}
+
+	guint32 *tip = (guint32 *)g_hash_table_lookup(reachability->tips, hash);
+
+	if (tip)
+		mask_or(mask, tip, reachability->words);
+
+	add_to_parents(reachability, revision, mask);
+
+	if (reachability->stack->len)
+		propagate(reachability, mask);
+}
+
+static gboolean
+on_idle_notify(GitgReachability *reachability)
+{
+	g_mutex_lock(reachability->mutex);
+
+	guint from = reachability->notified;
+	guint to = reachability->processed;
+
+	reachability->notified = to;
+	reachability->idle_id = 0;
+
+	g_mutex_unlock(reachability->mutex);
+
+	if (to > from)
+		reachability->func(reachability, from, to, reachability->userdata);
+
+	return FALSE;
+}
+
+static void
+free_batch(Batch *batch)
+{
+	g_free(batch->revisions);
+	g_slice_free(Batch, batch);
+}
+
+static gpointer
+worker(GitgReachability *reachability)
+{
+	Batch *batch;
+
+	while ((batch = (Batch *)g_async_queue_pop(reachability->queue)) != &stop_batch)
+	{
+		guint i;
+
+		if (g_atomic_int_get(&reachability->cancelled))
+		{
+			for (i = 0; i < batch->num; ++i)
+				gitg_revision_unref(batch->revisions[i]);
+
+			free_batch(batch);
+			continue;
+		}
+
+		for (i = 0; i < batch->num; ++i)
+		{
+			/* propagating can change masks of processed rows, so
+			   they are only written with the mutex held */
+			if (i % LOCK_CHUNK == 0)
+				g_mutex_lock(reachability->mutex);
+
+			process_revision(reachability, batch->revisions[i]);
+
+			if ((i + 1) % LOCK_CHUNK != 0 && i + 1 != batch->num)
+				continue;
+
+			reachability->processed = reachability->revisions->len;
+
+			if (reachability->func && !reachability->idle_id)
+				reachability->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)on_idle_notify, reachability, NULL);
+
+			g_mutex_unlock(reachability->mutex);
+		}
+
+		free_batch(batch);
+	}
+
+	return NULL;
+}
+
+GitgReachability *
+gitg_reachability_new(GSList *refs, GitgReachabilityFunc func, gpointer userdata)
+{
+	GitgReachability *reachability = g_slice_new0(GitgReachability);
+	GSList *item;
+	guint i = 0;
+
+	reachability->func = func;
+	reachability->userdata = userdata;
+
+	reachability->num_refs = g_slist_length(refs);
+	reachability->words = (reachability->num_refs + 31) / 32;
+	reachability->refs = g_new(GitgRef *, reachability->num_refs);
+	reachability->tips = g_hash_table_new_full(gitg_utils_hash_hash, gitg_utils_hash_equal, NULL, (GDestroyNotify)g_free);
+
+	for (item = refs; item; item = item->next)
+	{
+		GitgRef *ref = gitg_ref_copy((GitgRef *)item->data);
+		guint32 *tip = (guint32 *)g_hash_table_lookup(reachability->tips, ref->hash);
+
+		if (!tip)
+		{
+			tip = g_new0(guint32, reachability->words);
+			g_hash_table_insert(reachability->tips, ref->hash, tip);
+		}
+
+		tip[i / 32] |= 1u << (i % 32);
+		reachability->refs[i++] = ref;
+	}
+
+	reachability->revisions = g_ptr_array_new();
+	reachability->index = g_hash_table_new(gitg_utils_hash_hash, gitg_utils_hash_equal);
+	reachability->pending = g_hash_table_new_full(gitg_utils_hash_hash, gitg_utils_hash_equal, NULL, (GDestroyNotify)g_free);
+	reachability->stack = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	reachability->mutex = g_mutex_new();
+	reachability->queue = g_async_queue_new();
+	reachability->thread = g_thread_create((GThreadFunc)worker, reachability, TRUE, NULL);
+
+	return reachability;
+}
+
+void
+gitg_reachability_free(GitgReachability *reachability)
+{
+	guint i;
+
+	if (!reachability)
+		return;
+
+	g_atomic_int_set(&reachability->cancelled, 1);
+	g_async_queue_push(reachability->queue, &stop_batch);
+	g_thread_join(reachability->thread);
+
+	if (reachability->idle_id)
+		g_source_remove(reachability->idle_id);
+
+	g_async_queue_unref(reachability->queue);
+	g_mutex_free(reachability->mutex);
+
+	for (i = 0; i < reachability->revisions->len; ++i)
+		gitg_revision_unref(GITG_REVISION(g_ptr_array_index(reachability->revisions, i)));
+
+	g_ptr_array_free(reachability->revisions, TRUE);
+	g_hash_table_destroy(reachability->index);
+	g_hash_table_destroy(reachability->pending);
+	g_hash_table_destroy(reachability->tips);
+	g_array_free(reachability->stack, TRUE);
+
+	for (i = 0; i < reachability->num_refs; ++i)
+		gitg_ref_free(reachability->refs[i]);
+
+	g_free(reachability->refs);
+	g_free(reachability->masks);
+
+	g_slice_free(GitgReachability, reachability);
+}
+
+void
+gitg_reachability_push(GitgReachability *reachability, GitgRevision **revisions, guint num)
+{
+	guint i;
+
+	if (num == 0)
+		return;
+
+	Batch *batch = g_slice_new(Batch);
+	batch->revisions = g_new(GitgRevision *, num);
+	batch->num = num;
+
+	for (i = 0; i < num; ++i)
+		batch->revisions[i] = gitg_revision_ref(revisions[i]);
+
+	g_async_queue_push(reachability->queue, batch);
+}
+
+gint
+gitg_reachability_ref_index(GitgReachability *reachability, GitgRef const *ref)
+{
+	guint i;
+
+	for (i = 0; i < reachability->num_refs; ++i)
+	{
+		if (strcmp(reachability->refs[i]->name, ref->name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+gboolean
+gitg_reachability_contains(GitgReachability *reachability, gint ref_index, guint row)
+{
+	gboolean ret = FALSE;
+
+	if (ref_index < 0 || (guint)ref_index >= reachability->num_refs)
+		return FALSE;
+
+	g_mutex_lock(reachability->mutex);
+
+	if (row < reachability->processed)
+	{
+		guint32 const *mask = reachability->masks + row * reachability->words;
+		ret = (mask[ref_index / 32] & (1u << (ref_index % 32))) != 0;
+	}
+
+	g_mutex_unlock(reachability->mutex);
+	return ret;
+}
+
+GSList *
+gitg_reachability_get_refs(GitgReachability *reachability, guint row)
+{
+	GSList *ret = NULL;
+	guint i;
+
+	g_mutex_lock(reachability->mutex);
+
+	if (row < reachability->processed)
+	{
+		guint32 const *mask = reachability->masks + row * reachability->words;
+
+		for (i = 0; i < reachability->num_refs; ++i)
+		{
+			if (mask[i / 32] & (1u << (i % 32)))
+				ret = g_slist_prepend(ret, gitg_ref_copy(reachability->refs[i]));
+		}
+	}
+
+	g_mutex_unlock(reachability->mutex);
+	return g_slist_reverse(ret);
+}
@@ -0,0 +1,22 @@
+#ifndef __GITG_REACHABILITY_H__
+#define __GITG_REACHABILITY_H__
+
+#include <glib.h>
+#include "gitg-revision.h"
+#include "gitg-ref.h"
+
+typedef struct _GitgReachability GitgReachability;
+
+/* Called from the main loop when rows [from, to) have been processed */
+typedef void (*GitgReachabilityFunc)(GitgReachability *reachability, guint from, guint to, gpointer userdata);
+
+GitgReachability *gitg_reachability_new(GSList *refs, GitgReachabilityFunc func, gpointer userdata);
+void gitg_reachability_free(GitgReachability *reachability);
+
+void gitg_reachability_push(GitgReachability *reachability, GitgRevision **revisions, guint num);
+
+gint gitg_reachability_ref_index(GitgReachability *reachability, GitgRef const *ref);
+gboolean gitg_reachability_contains(GitgReachability *reachability, gint ref_index, guint row);
+GSList *gitg_reachability_get_refs(GitgReachability *reachability, guint row);
+
+#endif /* __GITG_REACHABILITY_H__ */
@@ -2,8 +2,11 @@
 #include "gitg-utils.h"
 #include "gitg-lanes.h"
 #include "gitg-ref.h"
+#include "gitg-reachability.h"
+#include "gitg-search.h"
 #include "gitg-types.h"
 
+#include <gtk/gtktreemodelfilter.h>
 #include <gio/gio.h>
 #include <glib/gi18n.h>
 #include <time.h>
@@ -21,13 +24,15 @@ enum {
 	PROP_0,
 	
 	PROP_PATH,
-	PROP_LOADER
+	PROP_LOADER,
+	PROP_RELATIVE_DATES
 };
 
 /* Signals */
 enum
 {
 	LOAD,
+	SEARCH_UPDATED,
 	LAST_SIGNAL
 };
 
@@ -53,14 +58,47 @@ struct _GitgRepositoryPrivate
 	GitgRevision **storage;
 	GitgLanes *lanes;
 	GHashTable *refs;
+	GitgReachability *reachability;
+	guint reachability_generation;
+	guint num_ref_filters;
+	
+	/* the last query is started again on every load */
+	GitgSearch *search;
+	gchar *search_key;
+	GitgSearchField search_field;
+	gboolean search_ignore_accents;
+	
+	/* content search (git log -S/-G), matching rows as a bitmask, hashes
+	   not loaded yet are resolved when they arrive */
+	GitgRunner *pickaxe;
+	gboolean search_changes;
+	gboolean search_regex;
+	guint32 *changes;
+	guint changes_words;
+	guint num_changes;
+	GHashTable *changes_pending;
 
 	gulong size;
 	gulong allocated;
 	gint grow_size;
 	
 	gchar **last_args;
+	
+	/* formatted dates, most recently used first */
+	GQueue *date_cache;
+	GHashTable *date_index;
+	gboolean relative_dates;
 };
 
+#define DATE_CACHE_SIZE 512
+
+typedef struct
+{
+	guint64 timestamp;
+	guint64 bucket;
+	gchar *text;
+} DateCacheEntry;
+
 inline static gint
 gitg_repository_error_quark()
 {
@@ -133,16 +171,81 @@ tree_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
 	return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
 }
 
-static gchar *
-timestamp_to_str(guint64 timestamp)
+static guint
+timestamp_hash(gconstpointer v)
 {
-	time_t t = timestamp;
+	guint64 t = *(guint64 const *)v;
+	return (guint)(t ^ (t >> 32));
+}
+
+static gboolean
+timestamp_equal(gconstpointer a, gconstpointer b)
+{
+	return *(guint64 const *)a == *(guint64 const *)b;
+}
 
-	struct tm *tms = localtime(&t);
-	char buf[255];
+static void
+free_date_cache_entry(DateCacheEntry *entry)
+{
+	g_free(entry->text);
+	g_slice_free(DateCacheEntry, entry);
+}
+
+static gchar const *
+format_date(GitgRepository *self, guint64 timestamp)
+{
+	/* localtime and strftime are too expensive to do for every cell on
+	   every redraw, so keep the most recently formatted dates around.
+	   Relative dates only change once a minute, so they are kept per
+	   minute */
+	GList *link = (GList *)g_hash_table_lookup(self->priv->date_index, &timestamp);
+	guint64 bucket = self->priv->relative_dates ? (guint64)time(NULL) / 60 : 0;
+	DateCacheEntry *entry;
+	
+	if (link)
+	{
+		if (link != self->priv->date_cache->head)
+		{
+			g_queue_unlink(self->priv->date_cache, link);
+			g_queue_push_head_link(self->priv->date_cache, link);
+		}
+		
+		entry = (DateCacheEntry *)link->data;
+		
+		if (entry->bucket != bucket)
+		{
+			g_free(entry->text);
+			entry->text = gitg_utils_timestamp_to_str(timestamp, self->priv->relative_dates);
+			entry->bucket = bucket;
+		}
+		
+		return entry->text;
+	}
 	
-	strftime(buf, 255, "%c", tms);
-	return g_strdup(buf);
+	if (self->priv->date_cache->length >= DATE_CACHE_SIZE)
+	{
+		/* reuse the least recently used entry */
+		link = g_queue_pop_tail_link(self->priv->date_cache);
+		entry = (DateCacheEntry *)link->data;
+		
+		g_hash_table_remove(self->priv->date_index, &entry->timestamp);
+		g_free(entry->text);
+	}
+	else
+	{
+		entry = g_slice_new(DateCacheEntry);
+		link = g_list_alloc();
+		link->data = entry;
+	}
+	
+	entry->timestamp = timestamp;
+	entry->bucket = bucket;
+	entry->text = gitg_utils_timestamp_to_str(timestamp, self->priv->relative_dates);
+	
+	g_queue_push_head_link(self->priv->date_cache, link);
+	g_hash_table_insert(self->priv->date_index, &entry->timestamp, link);
+	
+	return entry->text;
 }
 
 static void 
@@ -164,6 +267,8 @@ tree_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, G
 	switch (column)
 	{
 		case OBJECT_COLUMN:
+			/* lanes are only laid out for rows that are looked at */
+			gitg_lanes_ensure(rp->priv->lanes, rp->priv->storage, rp->priv->size, index);
 			g_value_set_boxed(value, rv);
 		break;
 		case SUBJECT_COLUMN:
@@ -173,7 +278,7 @@ tree_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, G
 			g_value_set_string(value, gitg_revision_get_author(rv));
 		break;
 		case DATE_COLUMN:
-			g_value_take_string(value, timestamp_to_str(gitg_revision_get_timestamp(rv)));
+			g_value_set_string(value, format_date(rp, gitg_revision_get_timestamp(rv)));
 		break;
 		default:
 			g_assert_not_reached();
@@ -278,6 +383,80 @@ gitg_repository_tree_model_iface_init(GtkTreeModelIface *iface)
 	iface->iter_parent = tree_model_iter_parent;
 }
 
+static void
+clear_changes(GitgRepository *repository)
+{
+	if (repository->priv->changes)
+		memset(repository->priv->changes, 0, repository->priv->changes_words * sizeof(guint32));
+	
+	repository->priv->num_changes = 0;
+	g_hash_table_remove_all(repository->priv->changes_pending);
+}
+
+static void
+set_change(GitgRepository *repository, guint row)
+{
+	guint word = row / 32;
+	
+	if (word >= repository->priv->changes_words)
+	{
+		guint prev = repository->priv->changes_words;
+		repository->priv->changes_words = MAX(word + 1, prev * 2);
+		repository->priv->changes = g_renew(guint32, repository->priv->changes, repository->priv->changes_words);
+		
+		memset(repository->priv->changes + prev, 0, (repository->priv->changes_words - prev) * sizeof(guint32));
+	}
+	
+	if (!(repository->priv->changes[word] & (1u << (row % 32))))
+	{
+		repository->priv->changes[word] |= 1u << (row % 32);
+		++repository->priv->num_changes;
+	}
+}
+
+static gboolean
+has_change(GitgRepository *repository, guint row)
+{
+	guint word = row / 32;
+	return word < repository->priv->changes_words && (repository->priv->changes[word] & (1u << (row % 32)));
+}
+
+static gint
+find_change(GitgRepository *repository, gint row, gboolean forward)
+{
+	guint32 const *changes = repository->priv->changes;
+	guint words = repository->priv->changes_words;
+	gint word;
+	gint bit;
+	
+	if (forward)
+	{
+		guint start = row < 0 ? 0 : (guint)row + 1;
+		
+		for (word = start / 32; word < words; ++word)
+		{
+			bit = g_bit_nth_lsf(changes[word], word == start / 32 ? (gint)(start % 32) - 1 : -1);
+			
+			if (bit != -1)
+				return word * 32 + bit;
+		}
+	}
+	else if (row > 0 && words > 0)
+	{
+		guint last = MIN((guint)row, words * 32) - 1;
+		
+		for (word = last / 32; word >= 0; --word)
+		{
+			bit = g_bit_nth_msf(changes[word], word == last / 32 ? (gint)(last % 32) + 1 : -1);
+			
+			if (bit != -1)
+				return word * 32 + bit;
+		}
+	}
+	
+	return -1;
+}
+
 static void
 do_clear(GitgRepository *repository, gboolean emit)
 {
@@ -306,9 +485,20 @@ do_clear(GitgRepository *repository, gboolean emit)
 	repository->priv->size = 0;
 	repository->priv->allocated = 0;
 	
+	gitg_lanes_reset(repository->priv->lanes);
+	
 	/* clear hash tables */
 	g_hash_table_remove_all(repository->priv->hashtable);
 	g_hash_table_remove_all(repository->priv->refs);
+	
+	gitg_reachability_free(repository->priv->reachability);
+	repository->priv->reachability = NULL;
+	
+	gitg_search_free(repository->priv->search);
+	repository->priv->search = NULL;
+	
+	gitg_runner_cancel(repository->priv->pickaxe);
+	clear_changes(repository);
 }
 
 static void
@@ -320,10 +510,12 @@ gitg_repository_finalize(GObject *object)
 	gitg_runner_cancel(rp->priv->loader);
 	g_object_unref(rp->priv->loader);
 	
-	g_object_unref(rp->priv->lanes);
+	g_signal_handlers_disconnect_matched(rp->priv->pickaxe, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, rp);
 	
 	/* Clear the model to remove all revision objects */
 	do_clear(rp, FALSE);
+	g_object_unref(rp->priv->lanes);
+	g_object_unref(rp->priv->pickaxe);
 	
 	/* Free the path */
 	g_free(rp->priv->path);
@@ -334,10 +526,66 @@ gitg_repository_finalize(GObject *object)
 	
 	/* Free cached args */
 	g_strfreev(rp->priv->last_args);
+	g_free(rp->priv->search_key);
+	g_free(rp->priv->changes);
+	g_hash_table_destroy(rp->priv->changes_pending);
+	
+	/* Free date cache */
+	g_hash_table_destroy(rp->priv->date_index);
+	g_queue_foreach(rp->priv->date_cache, (GFunc)free_date_cache_entry, NULL);
+	g_queue_free(rp->priv->date_cache);
 
 	G_OBJECT_CLASS (gitg_repository_parent_class)->finalize(object);
 }
 
+static void
+emit_rows_changed(GitgRepository *self, guint from, guint to)
+{
+	if (from >= to || from >= self->priv->size)
+		return;
+
+	GtkTreeIter iter;
+	GtkTreePath *path = gtk_tree_path_new_from_indices(from, -1);
+	guint i;
+	
+	iter.stamp = self->priv->stamp;
+	iter.user_data2 = NULL;
+	iter.user_data3 = NULL;
+	
+	for (i = from; i < to && i < self->priv->size; ++i)
+	{
+		iter.user_data = GUINT_TO_POINTER(i);
+		gtk_tree_model_row_changed(GTK_TREE_MODEL(self), path, &iter);
+		gtk_tree_path_next(path);
+	}
+	
+	gtk_tree_path_free(path);
+}
+
+static void
+set_relative_dates(GitgRepository *self, gboolean relative_dates)
+{
+	if (self->priv->relative_dates == relative_dates)
+		return;
+	
+	self->priv->relative_dates = relative_dates;
+	
+	/* the cached texts are in the other format now */
+	g_hash_table_remove_all(self->priv->date_index);
+	g_queue_foreach(self->priv->date_cache, (GFunc)free_date_cache_entry, NULL);
+	g_queue_clear(self->priv->date_cache);
+	
+	if (self->priv->search)
+	{
+		gitg_search_set_relative_dates(self->priv->search, relative_dates);
+		
+		if (self->priv->search_key && !self->priv->search_changes && self->priv->search_field == GITG_SEARCH_DATE)
+			gitg_search_start(self->priv->search, self->priv->search_field, self->priv->search_key, self->priv->search_ignore_accents);
+	}
+	
+	emit_rows_changed(self, 0, self->priv->size);
+}
+
 static void
 gitg_repository_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
 {
@@ -349,6 +597,9 @@ gitg_repository_set_property(GObject *object, guint prop_id, GValue const *value
 			g_free(self->priv->path);
 			self->priv->path = gitg_utils_find_git(g_value_get_string(value));
 		break;
+		case PROP_RELATIVE_DATES:
+			set_relative_dates(self, g_value_get_boolean(value));
+		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -368,6 +619,9 @@ gitg_repository_get_property(GObject *object, guint prop_id, GValue *value, GPar
 		case PROP_LOADER:
 			g_value_set_object(value, self->priv->loader);
 		break;
+		case PROP_RELATIVE_DATES:
+			g_value_set_boolean(value, self->priv->relative_dates);
+		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -397,6 +651,13 @@ gitg_repository_class_init(GitgRepositoryClass *klass)
 								      GITG_TYPE_RUNNER,
 								      G_PARAM_READABLE));
 	
+	g_object_class_install_property(object_class, PROP_RELATIVE_DATES,
+						 g_param_spec_boolean ("relative-dates",
+								      "RELATIVE_DATES",
+								      "Show dates relative to now",
+								      FALSE,
+								      G_PARAM_READWRITE));
+	
 	repository_signals[LOAD] =
    		g_signal_new ("load",
 			      G_OBJECT_CLASS_TYPE (object_class),
@@ -406,6 +667,16 @@ gitg_repository_class_init(GitgRepositoryClass *klass)
 			      g_cclosure_marshal_VOID__VOID,
 			      G_TYPE_NONE,
 			      0);
+	
+	repository_signals[SEARCH_UPDATED] =
+   		g_signal_new ("search-updated",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (GitgRepositoryClass, search_updated),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__BOOLEAN,
+			      G_TYPE_NONE,
+			      1, G_TYPE_BOOLEAN);
 
 	g_type_class_add_private(object_class, sizeof(GitgRepositoryPrivate));
 }
@@ -414,6 +685,8 @@ static void
 on_loader_update(GitgRunner *object, gchar **buffer, GitgRepository *self)
 {
 	gchar *line;
+	gulong start = self->priv->size;
+	gboolean resolved = FALSE;
 	
 	while ((line = *buffer++))
 	{
@@ -431,25 +704,89 @@ on_loader_update(GitgRunner *object, gchar **buffer, GitgRepository *self)
 		gint64 timestamp = g_ascii_strtoll(components[4], NULL, 0);
 	
 		GitgRevision *rv = gitg_revision_new(components[0], components[1], components[2], components[3], timestamp);
-		GSList *lanes;
 		
 		if (len > 5 && strlen(components[5]) == 1 && strchr("<>-^", *components[5]) != NULL)
 			gitg_revision_set_sign(rv, *components[5]);
 
-		gint8 mylane = 0;
-		
-		if (self->priv->size == 0)
-			gitg_lanes_reset(self->priv->lanes);
-
-		lanes = gitg_lanes_next(self->priv->lanes, rv, &mylane);
-		
-		gitg_revision_set_lanes(rv, lanes, mylane);
-
 		gitg_repository_add(self, rv, NULL);
+		
+		/* content search hit that arrived before the revision */
+		if (g_hash_table_size(self->priv->changes_pending) && g_hash_table_remove(self->priv->changes_pending, gitg_revision_get_hash(rv)))
+		{
+			set_change(self, self->priv->size - 1);
+			resolved = TRUE;
+		}
 
 		gitg_revision_unref(rv);
 		g_strfreev(components);
 	}
+	
+	if (self->priv->reachability)
+		gitg_reachability_push(self->priv->reachability, self->priv->storage + start, self->priv->size - start);
+	
+	if (self->priv->search)
+		gitg_search_push(self->priv->search, self->priv->storage + start, self->priv->size - start);
+	
+	if (resolved)
+		g_signal_emit(self, repository_signals[SEARCH_UPDATED], 0, !gitg_runner_running(self->priv->pickaxe));
+}
+
+static void
+on_pickaxe_update(GitgRunner *runner, gchar **buffer, GitgRepository *self)
+{
+	gchar *line;
+	
+	while ((line = *buffer++))
+	{
+		if (strlen(line) != 40)
+			continue;
+
+		Hash hash;
+		gpointer row;
+		
+		gitg_utils_sha1_to_hash(line, hash);
+		
+		if (g_hash_table_lookup_extended(self->priv->hashtable, hash, NULL, &row))
+			set_change(self, GPOINTER_TO_UINT(row));
+		else
+			g_hash_table_insert(self->priv->changes_pending, g_memdup(hash, sizeof(Hash)), NULL);
+	}
+	
+	g_signal_emit(self, repository_signals[SEARCH_UPDATED], 0, FALSE);
+}
+
+static void
+on_pickaxe_end_loading(GitgRunner *runner, GitgRepository *self)
+{
+	g_signal_emit(self, repository_signals[SEARCH_UPDATED], 0, TRUE);
+}
+
+static void
+run_pickaxe(GitgRepository *self)
+{
+	gitg_runner_cancel(self->priv->pickaxe);
+	clear_changes(self);
+	
+	if (!self->priv->search_changes || !self->priv->search_key || !self->priv->last_args)
+		return;
+	
+	/* the revisions of the history, only printing their hash */
+	guint num = g_strv_length(self->priv->last_args);
+	gchar const **argv = g_new0(gchar const *, num + 2);
+	gchar *pickaxe = g_strconcat(self->priv->search_regex ? "-G" : "-S", self->priv->search_key, NULL);
+	guint i;
+	
+	argv[0] = "log";
+	argv[1] = "--pretty=format:%H";
+	argv[2] = pickaxe;
+	
+	for (i = 2; i < num; ++i)
+		argv[i + 1] = self->priv->last_args[i];
+	
+	gitg_repository_run_command(self, self->priv->pickaxe, argv, NULL);
+	
+	g_free(pickaxe);
+	g_free(argv);
 }
 
 static void
@@ -472,11 +809,19 @@ gitg_repository_init(GitgRepository *object)
 	
 	object->priv->lanes = gitg_lanes_new();
 	object->priv->grow_size = 1000;
+	
+	object->priv->date_cache = g_queue_new();
+	object->priv->date_index = g_hash_table_new(timestamp_hash, timestamp_equal);
 	object->priv->stamp = g_random_int();
 	object->priv->refs = g_hash_table_new_full(gitg_utils_hash_hash, gitg_utils_hash_equal, NULL, (GDestroyNotify)free_refs);
 	
 	object->priv->loader = gitg_runner_new(10000);
 	g_signal_connect(object->priv->loader, "update", G_CALLBACK(on_loader_update), object);
+	
+	object->priv->changes_pending = g_hash_table_new_full(gitg_utils_hash_hash, gitg_utils_hash_equal, (GDestroyNotify)g_free, NULL);
+	object->priv->pickaxe = gitg_runner_new(100);
+	g_signal_connect(object->priv->pickaxe, "update", G_CALLBACK(on_pickaxe_update), object);
+	g_signal_connect(object->priv->pickaxe, "end-loading", G_CALLBACK(on_pickaxe_end_loading), object);
 }
 
 static void
@@ -520,6 +865,13 @@ gitg_repository_get_loader(GitgRepository *self)
 	return GITG_RUNNER(g_object_ref(self->priv->loader));
 }
 
+GitgLanes *
+gitg_repository_get_lanes(GitgRepository *self)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(self), NULL);
+	return GITG_LANES(g_object_ref(self->priv->lanes));
+}
+
 static void
 add_ref(GitgRepository *self, gchar const *sha1, gchar const *name)
 {
@@ -548,7 +900,12 @@ static gboolean
 reload_revisions(GitgRepository *repository, GError **error)
 {
 	g_signal_emit(repository, repository_signals[LOAD], 0);
-	return gitg_repository_run_command(repository, repository->priv->loader, (gchar const **)repository->priv->last_args, error);
+	
+	if (!gitg_repository_run_command(repository, repository->priv->loader, (gchar const **)repository->priv->last_args, error))
+		return FALSE;
+	
+	run_pickaxe(repository);
+	return TRUE;
 }
 
 static gboolean
@@ -613,6 +970,42 @@ load_refs(GitgRepository *self)
 	g_strfreev(refs);
 }
 
+static void
+on_reachability_update(GitgReachability *reachability, guint from, guint to, GitgRepository *self)
+{
+	/* only needed to let ref filters re-evaluate the processed rows */
+	if (self->priv->num_ref_filters == 0)
+		return;
+	
+	emit_rows_changed(self, from, to);
+}
+
+static void
+load_reachability(GitgRepository *self)
+{
+	GSList *refs = gitg_repository_get_refs(self);
+	
+	self->priv->reachability = gitg_reachability_new(refs, (GitgReachabilityFunc)on_reachability_update, self);
+	self->priv->reachability_generation++;
+	free_refs(refs);
+}
+
+static void
+on_search_update(GitgSearch *search, gboolean finished, GitgRepository *self)
+{
+	g_signal_emit(self, repository_signals[SEARCH_UPDATED], 0, finished);
+}
+
+static void
+load_search(GitgRepository *self)
+{
+	self->priv->search = gitg_search_new((GitgSearchFunc)on_search_update, self);
+	gitg_search_set_relative_dates(self->priv->search, self->priv->relative_dates);
+	
+	if (self->priv->search_key && !self->priv->search_changes)
+		gitg_search_start(self->priv->search, self->priv->search_field, self->priv->search_key, self->priv->search_ignore_accents);
+}
+
 void
 gitg_repository_reload(GitgRepository *repository)
 {
@@ -623,6 +1016,8 @@ gitg_repository_reload(GitgRepository *repository)
 	gitg_repository_clear(repository);
 	
 	load_refs(repository);
+	load_reachability(repository);
+	load_search(repository);
 	reload_revisions(repository, NULL);
 }
 
@@ -644,6 +1039,8 @@ gitg_repository_load(GitgRepository *self, int argc, gchar const **av, GError **
 	
 	/* first get the refs */
 	load_refs(self);
+	load_reachability(self);
+	load_search(self);
 
 	/* request log (all the revision) */
 	return load_revisions(self, argc, av, error);
@@ -698,6 +1095,39 @@ gitg_repository_lookup(GitgRepository *store, gchar const *hash)
 	return store->priv->storage[GPOINTER_TO_UINT(result)];
 }
 
+gint
+gitg_repository_get_row(GitgRepository *repository, GtkTreeIter *iter)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), -1);
+	g_return_val_if_fail(iter->stamp == repository->priv->stamp, -1);
+	
+	return GPOINTER_TO_INT(iter->user_data);
+}
+
+GitgRevision *
+gitg_repository_peek(GitgRepository *repository, guint row)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), NULL);
+	
+	if (row >= repository->priv->size)
+		return NULL;
+	
+	gitg_lanes_ensure(repository->priv->lanes, repository->priv->storage, repository->priv->size, row);
+	return repository->priv->storage[row];
+}
+
+/* The hash of a row, without laying out its lanes */
+gchar const *
+gitg_repository_peek_hash(GitgRepository *repository, guint row)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), NULL);
+	
+	if (row >= repository->priv->size)
+		return NULL;
+	
+	return gitg_revision_get_hash(repository->priv->storage[row]);
+}
+
 gboolean
 gitg_repository_find_by_hash(GitgRepository *store, gchar const *hash, GtkTreeIter *iter)
 {
@@ -748,6 +1178,186 @@ gitg_repository_get_refs_for_hash(GitgRepository *repository, gchar const *hash)
 	return g_slist_copy((GSList *)g_hash_table_lookup(repository->priv->refs, hash));
 }
 
+GSList *
+gitg_repository_peek_refs_for_hash(GitgRepository *repository, gchar const *hash)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), NULL);
+	return (GSList *)g_hash_table_lookup(repository->priv->refs, hash);
+}
+
+void
+gitg_repository_search(GitgRepository *repository, GitgSearchField field, gchar const *key, gboolean ignore_accents)
+{
+	g_return_if_fail(GITG_IS_REPOSITORY(repository));
+	
+	g_free(repository->priv->search_key);
+	repository->priv->search_key = key && *key ? g_strdup(key) : NULL;
+	repository->priv->search_field = field;
+	repository->priv->search_ignore_accents = ignore_accents;
+	
+	if (repository->priv->search_changes)
+	{
+		repository->priv->search_changes = FALSE;
+		run_pickaxe(repository);
+	}
+	
+	if (repository->priv->search)
+		gitg_search_start(repository->priv->search, field, repository->priv->search_key, ignore_accents);
+}
+
+void
+gitg_repository_search_changes(GitgRepository *repository, gchar const *key, gboolean regex)
+{
+	g_return_if_fail(GITG_IS_REPOSITORY(repository));
+	
+	g_free(repository->priv->search_key);
+	repository->priv->search_key = key && *key ? g_strdup(key) : NULL;
+	repository->priv->search_changes = TRUE;
+	repository->priv->search_regex = regex;
+	
+	if (repository->priv->search)
+		gitg_search_cancel(repository->priv->search);
+	
+	run_pickaxe(repository);
+}
+
+void
+gitg_repository_search_cancel(GitgRepository *repository)
+{
+	g_return_if_fail(GITG_IS_REPOSITORY(repository));
+	
+	g_free(repository->priv->search_key);
+	repository->priv->search_key = NULL;
+	
+	gitg_runner_cancel(repository->priv->pickaxe);
+	clear_changes(repository);
+	
+	if (repository->priv->search)
+		gitg_search_cancel(repository->priv->search);
+}
+
+gboolean
+gitg_repository_search_running(GitgRepository *repository)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), FALSE);
+	return gitg_runner_running(repository->priv->pickaxe);
+}
+
+gint
+gitg_repository_search_find(GitgRepository *repository, gint row, gboolean forward)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), -1);
+	
+	if (repository->priv->search_changes)
+		return find_change(repository, row, forward);
+	
+	if (!repository->priv->search)
+		return -1;
+	
+	return gitg_search_find(repository->priv->search, row, forward);
+}
+
+gboolean
+gitg_repository_search_is_match(GitgRepository *repository, guint row)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), FALSE);
+	
+	if (!repository->priv->search_key)
+		return FALSE;
+	
+	if (repository->priv->search_changes)
+		return has_change(repository, row);
+	
+	if (!repository->priv->search)
+		return FALSE;
+	
+	return gitg_search_is_match(repository->priv->search, row);
+}
+
+guint
+gitg_repository_search_get_num_matches(GitgRepository *repository)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), 0);
+	
+	if (repository->priv->search_changes)
+		return repository->priv->num_changes;
+	
+	if (!repository->priv->search)
+		return 0;
+	
+	return gitg_search_get_num_matches(repository->priv->search);
+}
+
+GSList *
+gitg_repository_get_refs_containing(GitgRepository *repository, GitgRevision *revision)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), NULL);
+	
+	gpointer result;
+	
+	if (!repository->priv->reachability || !g_hash_table_lookup_extended(repository->priv->hashtable, gitg_revision_get_hash(revision), NULL, &result))
+		return NULL;
+	
+	return gitg_reachability_get_refs(repository->priv->reachability, GPOINTER_TO_UINT(result));
+}
+
+typedef struct
+{
+	GitgRepository *repository;
+	GitgRef *ref;
+	
+	/* index of ref in the reachability of this generation */
+	guint generation;
+	gint index;
+} RefFilter;
+
+static void
+free_ref_filter(RefFilter *filter)
+{
+	filter->repository->priv->num_ref_filters--;
+
+	g_object_unref(filter->repository);
+	gitg_ref_free(filter->ref);
+	g_slice_free(RefFilter, filter);
+}
+
+static gboolean
+ref_filter_visible(GtkTreeModel *model, GtkTreeIter *iter, RefFilter *filter)
+{
+	GitgReachability *reachability = filter->repository->priv->reachability;
+	
+	if (!reachability)
+		return FALSE;
+	
+	/* ref indices change on every load */
+	if (filter->generation != filter->repository->priv->reachability_generation)
+	{
+		filter->generation = filter->repository->priv->reachability_generation;
+		filter->index = gitg_reachability_ref_index(reachability, filter->ref);
+	}
+	
+	return gitg_reachability_contains(reachability, filter->index, GPOINTER_TO_UINT(iter->user_data));
+}
+
+GtkTreeModel *
+gitg_repository_filter_by_ref(GitgRepository *repository, GitgRef *ref)
+{
+	g_return_val_if_fail(GITG_IS_REPOSITORY(repository), NULL);
+	g_return_val_if_fail(ref != NULL, NULL);
+	
+	RefFilter *filter = g_slice_new0(RefFilter);
+	filter->repository = g_object_ref(repository);
+	filter->ref = gitg_ref_copy(ref);
+	filter->index = -1;
+	
+	repository->priv->num_ref_filters++;
+	
+	GtkTreeModel *model = gtk_tree_model_filter_new(GTK_TREE_MODEL(repository), NULL);
+	gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(model), (GtkTreeModelFilterVisibleFunc)ref_filter_visible, filter, (GDestroyNotify)free_ref_filter);
+	
+	return model;
+}
+
 gchar *
 gitg_repository_relative(GitgRepository *repository, GFile *file)
 {
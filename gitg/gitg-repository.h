@@ -5,6 +5,9 @@
 
 #include "gitg-revision.h"
 #include "gitg-runner.h"
+#include "gitg-ref.h"
+#include "gitg-lanes.h"
+#include "gitg-search.h"
 
 G_BEGIN_DECLS
 
@@ -38,12 +41,14 @@ struct _GitgRepositoryClass
 	GObjectClass parent_class;
 	
 	void (*load) (GitgRepository *);
+	void (*search_updated) (GitgRepository *, gboolean finished);
 };
 
 GType gitg_repository_get_type (void) G_GNUC_CONST;
 GitgRepository *gitg_repository_new(gchar const *path);
 gchar const *gitg_repository_get_path(GitgRepository *repository);
 GitgRunner *gitg_repository_get_loader(GitgRepository *repository);
+GitgLanes *gitg_repository_get_lanes(GitgRepository *repository);
 
 gboolean gitg_repository_load(GitgRepository *repository, int argc, gchar const **argv, GError **error);
 
@@ -54,9 +59,28 @@ gboolean gitg_repository_find_by_hash(GitgRepository *self, gchar const *hash, G
 gboolean gitg_repository_find(GitgRepository *store, GitgRevision *revision, GtkTreeIter *iter);
 GitgRevision *gitg_repository_lookup(GitgRepository *store, gchar const *hash);
 
+/* Borrowed access to rows, valid until the repository changes */
+gint gitg_repository_get_row(GitgRepository *repository, GtkTreeIter *iter);
+GitgRevision *gitg_repository_peek(GitgRepository *repository, guint row);
+gchar const *gitg_repository_peek_hash(GitgRepository *repository, guint row);
+GSList *gitg_repository_peek_refs_for_hash(GitgRepository *repository, gchar const *hash);
+
+/* Searching runs in the background, search-updated is emitted when new
+   matches were found. Content searches run git log -S (or -G for a regex) */
+void gitg_repository_search(GitgRepository *repository, GitgSearchField field, gchar const *key, gboolean ignore_accents);
+void gitg_repository_search_changes(GitgRepository *repository, gchar const *key, gboolean regex);
+void gitg_repository_search_cancel(GitgRepository *repository);
+gboolean gitg_repository_search_running(GitgRepository *repository);
+gint gitg_repository_search_find(GitgRepository *repository, gint row, gboolean forward);
+gboolean gitg_repository_search_is_match(GitgRepository *repository, guint row);
+guint gitg_repository_search_get_num_matches(GitgRepository *repository);
+
 GSList *gitg_repository_get_refs(GitgRepository *repository);
 GSList *gitg_repository_get_refs_for_hash(GitgRepository *repository, gchar const *hash);
 
+GSList *gitg_repository_get_refs_containing(GitgRepository *repository, GitgRevision *revision);
+GtkTreeModel *gitg_repository_filter_by_ref(GitgRepository *repository, GitgRef *ref);
+
 gchar *gitg_repository_relative(GitgRepository *repository, GFile *file);
 
 /* Running git commands */
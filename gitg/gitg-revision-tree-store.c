@@ -88,7 +88,8 @@ gitg_revision_tree_store_init(GitgRevisionTreeStore *self)
 	GType column_types[] = {
 		GDK_TYPE_PIXBUF,
 		G_TYPE_STRING,
-		G_TYPE_STRING
+		G_TYPE_STRING,
+		G_TYPE_UINT
 	};
 	
 	gtk_tree_store_set_column_types(GTK_TREE_STORE(self), GITG_REVISION_TREE_STORE_N_COLUMNS, column_types);
@@ -21,6 +21,7 @@ enum {
 	GITG_REVISION_TREE_STORE_ICON_COLUMN,
 	GITG_REVISION_TREE_STORE_NAME_COLUMN,
 	GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN,
+	GITG_REVISION_TREE_STORE_NODE_COLUMN,
 	GITG_REVISION_TREE_STORE_N_COLUMNS
 };
 
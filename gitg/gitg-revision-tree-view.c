@@ -4,6 +4,7 @@
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "gitg-revision-tree-view.h"
 #include "gitg-revision-tree-store.h"
@@ -34,12 +35,33 @@ struct _GitgRevisionTreeViewPrivate
 	GitgRepository *repository;
 	GitgRevision *revision;
 	GitgRunner *loader;
-	GtkTreePath *load_path;
+	gboolean loading;
+	
+	/* the tree is loaded when the view is shown */
+	gboolean load_pending;
+	
+	/* the whole tree of the revision, rows are added to the store when
+	   their parent is expanded */
+	GArray *nodes;
+	GString *paths;
+	GArray *stack;
 };
 
+/* Node 0 is the root of the tree. The full path of every entry is stored
+   once in paths, name points to its last component */
+typedef struct
+{
+	guint path;
+	guint name;
+	guint first_child;
+	guint next;
+	guint64 size;
+	guint is_dir : 1;
+	guint materialized : 1;
+} TreeNode;
+
 static void gitg_revision_tree_view_buildable_iface_init(GtkBuildableIface *iface);
-static void load_node(GitgRevisionTreeView *view, GtkTreeIter *parent);
-static gchar *node_identity(GitgRevisionTreeView *view, GtkTreeIter *iter);
+static void materialize_children(GitgRevisionTreeView *tree, GtkTreeIter *parent);
 
 G_DEFINE_TYPE_EXTENDED(GitgRevisionTreeView, gitg_revision_tree_view, GTK_TYPE_HPANED, 0,
 	G_IMPLEMENT_INTERFACE(GTK_TYPE_BUILDABLE, gitg_revision_tree_view_buildable_iface_init));
@@ -57,16 +79,18 @@ gitg_revision_tree_view_finalize(GObject *object)
 	if (self->priv->repository)
 		g_object_unref(self->priv->repository);
 	
-	if (self->priv->load_path)
-		gtk_tree_path_free(self->priv->load_path);
-	
 	g_free(self->priv->drag_dir);
 	
 	if (self->priv->drag_files)
 		g_strfreev(self->priv->drag_files);
 	
+	self->priv->loading = FALSE;
 	gitg_runner_cancel(self->priv->loader);
 	g_object_unref(self->priv->loader);
+	
+	g_array_free(self->priv->nodes, TRUE);
+	g_string_free(self->priv->paths, TRUE);
+	g_array_free(self->priv->stack, TRUE);
 
 	G_OBJECT_CLASS(gitg_revision_tree_view_parent_class)->finalize(object);
 }
@@ -106,14 +130,12 @@ gitg_revision_tree_view_set_property(GObject *object, guint prop_id, const GValu
 				g_object_unref(self->priv->repository);
 			
 			self->priv->repository = g_value_dup_object(value);
-			gitg_revision_tree_view_reload(self);
 		break;
 		case PROP_REVISION:
 			if (self->priv->revision)
 				gitg_revision_unref(self->priv->revision);
 				
 			self->priv->revision = g_value_dup_boxed(value);
-			gitg_revision_tree_view_reload(self);
 		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -121,34 +143,32 @@ gitg_revision_tree_view_set_property(GObject *object, guint prop_id, const GValu
 	}
 }
 
-static gboolean
-loaded(GitgRevisionTreeView *view, GtkTreeIter *iter)
+static TreeNode *
+get_node(GitgRevisionTreeView *tree, guint index)
 {
-	gint num = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(view->priv->store), iter);
-	
-	if (num != 1)
-		return TRUE;
-	
-	gchar *content_type = NULL;
-	GtkTreeIter child;
-	
-	if (!gtk_tree_model_iter_children(GTK_TREE_MODEL(view->priv->store), &child, iter))
-		return FALSE;
+	return &g_array_index(tree->priv->nodes, TreeNode, index);
+}
 
-	gtk_tree_model_get(GTK_TREE_MODEL(view->priv->store), &child, GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, &content_type, -1);
-	gboolean ret = content_type != NULL;
-	g_free(content_type);
+static TreeNode *
+get_iter_node(GitgRevisionTreeView *tree, GtkTreeModel *model, GtkTreeIter *iter)
+{
+	guint index;
+	gtk_tree_model_get(model, iter, GITG_REVISION_TREE_STORE_NODE_COLUMN, &index, -1);
 	
-	return ret;
+	return index < tree->priv->nodes->len ? get_node(tree, index) : NULL;
+}
+
+static gchar const *
+node_path(GitgRevisionTreeView *tree, TreeNode *node)
+{
+	return tree->priv->paths->str + node->path;
 }
 
 static void
 on_row_expanded(GtkTreeView *tree_view, GtkTreeIter *iter, GtkTreePath *path, GitgRevisionTreeView *view)
 {
-	if (loaded(view, iter))
-		return;
-	
-	load_node(view, iter);
+	/* the children are there already, their children make them expandable */
+	materialize_children(view, iter);
 }
 
 static void
@@ -192,8 +212,13 @@ on_selection_changed(GtkTreeSelection *selection, GitgRevisionTreeView *tree)
 	gtk_tree_path_free(path);
 	gtk_tree_model_get(model, &iter, GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, &content_type, -1);
 	
-	if (!content_type)
+	TreeNode *node = get_iter_node(tree, model, &iter);
+	
+	if (!content_type || !node)
+	{
+		g_free(content_type);
 		return;
+	}
 	
 	if (!gitg_utils_can_display_content_type(content_type))
 	{
@@ -204,42 +229,22 @@ on_selection_changed(GtkTreeSelection *selection, GitgRevisionTreeView *tree)
 		GtkSourceLanguage *language = gitg_utils_get_language(content_type);
 		gtk_source_buffer_set_language(GTK_SOURCE_BUFFER(buffer), language);
 		
-		gchar *id = node_identity(tree, &iter);
-		gitg_repository_run_commandv(tree->priv->repository, tree->priv->content_runner, NULL, "show", id, NULL);
-		
-		g_free(id);
+		/* empty files need no loading */
+		if (node->size != 0)
+		{
+			gchar *sha = gitg_revision_get_sha1(tree->priv->revision);
+			gchar *id = g_strconcat(sha, ":", node_path(tree, node), NULL);
+			
+			gitg_repository_run_commandv(tree->priv->repository, tree->priv->content_runner, NULL, "show", id, NULL);
+			
+			g_free(sha);
+			g_free(id);
+		}
 	}
 	
 	g_free(content_type);
 }
 
-static gchar *
-node_path(GtkTreeModel *model, GtkTreeIter *parent)
-{
-	if (!parent)
-		return NULL;
-	
-	gchar *name;
-	gtk_tree_model_get(model, parent, GITG_REVISION_TREE_STORE_NAME_COLUMN, &name, -1);
-	
-	GtkTreeIter parent_iter;
-	gchar *ret;
-	
-	if (gtk_tree_model_iter_parent(model, &parent_iter, parent))
-	{
-		gchar *path = node_path(model, &parent_iter);
-		ret = g_build_filename(path, name, NULL);
-		g_free(path);
-		g_free(name);
-	}
-	else
-	{
-		ret = name;
-	}
-	
-	return ret;
-}
-
 static void
 export_drag_files(GitgRevisionTreeView *tree_view)
 {
@@ -263,7 +268,8 @@ export_drag_files(GitgRevisionTreeView *tree_view)
 		GtkTreeIter iter;
 		gtk_tree_model_get_iter(model, &iter, path);
 		
-		*ptr++ = node_path(model, &iter);
+		TreeNode *node = get_iter_node(tree_view, model, &iter);
+		*ptr++ = g_strdup(node ? node_path(tree_view, node) : "");
 		gtk_tree_path_free(path);
 	}
 	
@@ -307,28 +313,6 @@ on_drag_data_get(GtkWidget *widget, GdkDragContext *context, GtkSelectionData *s
 	gtk_selection_data_set_uris(selection, tree_view->priv->drag_files);
 }
 
-static gboolean
-test_selection(GtkTreeSelection *selection, GtkTreeModel *model, GtkTreePath *path, gboolean path_currently_selected, gpointer data)
-{
-	if (path_currently_selected)
-		return TRUE;
-	
-	// Test for (Empty)
-	GtkTreeIter iter;
-	
-	if (!gtk_tree_model_get_iter(model, &iter, path))
-		return FALSE;
-	
-	gchar *content_type;
-	gtk_tree_model_get(model, &iter, GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, &content_type, -1);
-	
-	if (!content_type)
-		return FALSE;
-	
-	g_free(content_type);
-	return TRUE;
-}
-
 static void
 on_drag_end(GtkWidget *widget, GdkDragContext *context, GitgRevisionTreeView *tree_view)
 {
@@ -360,7 +344,6 @@ gitg_revision_tree_view_parser_finished(GtkBuildable *buildable, GtkBuilder *bui
 
 	GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view->priv->tree_view);
 	gtk_tree_selection_set_mode(selection, GTK_SELECTION_MULTIPLE);
-	gtk_tree_selection_set_select_function(selection, test_selection, NULL, NULL);
 	
 	// Setup drag source
 	GtkTargetEntry targets[] = {
@@ -386,14 +369,28 @@ gitg_revision_tree_view_buildable_iface_init(GtkBuildableIface *iface)
 	iface->parser_finished = gitg_revision_tree_view_parser_finished;
 }
 
+static void
+gitg_revision_tree_view_map(GtkWidget *widget)
+{
+	GitgRevisionTreeView *self = GITG_REVISION_TREE_VIEW(widget);
+	
+	GTK_WIDGET_CLASS(gitg_revision_tree_view_parent_class)->map(widget);
+	
+	if (self->priv->load_pending)
+		gitg_revision_tree_view_reload(self);
+}
+
 static void
 gitg_revision_tree_view_class_init(GitgRevisionTreeViewClass *klass)
 {
 	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
 	
 	object_class->finalize = gitg_revision_tree_view_finalize;
 	object_class->set_property = gitg_revision_tree_view_set_property;
 	object_class->get_property = gitg_revision_tree_view_get_property;
+	
+	widget_class->map = gitg_revision_tree_view_map;
 
 	g_object_class_install_property(object_class, PROP_REPOSITORY,
 						 g_param_spec_object ("repository",
@@ -413,7 +410,7 @@ gitg_revision_tree_view_class_init(GitgRevisionTreeViewClass *klass)
 }
 
 static gchar *
-get_content_type(gchar *name, gboolean dir)
+get_content_type(gchar const *name, gboolean dir)
 {
 	if (dir)
 		return g_strdup("inode/directory");
@@ -421,87 +418,14 @@ get_content_type(gchar *name, gboolean dir)
 		return g_content_type_guess(name, NULL, 0, NULL);
 }
 
-static void
-remove_dummy(GitgRevisionTreeView *tree)
+static GdkPixbuf *
+get_icon(gchar const *content_type, gboolean dir)
 {
-	if (!tree->priv->load_path)
-		return;
-	
-	GtkTreeIter parent;
-	GtkTreeModel *model = GTK_TREE_MODEL(tree->priv->store);
-	gtk_tree_model_get_iter(model, &parent, tree->priv->load_path);
+	GIcon *icon = g_content_type_get_icon(content_type);
+	GdkPixbuf *pixbuf = NULL;
 	
-	if (gtk_tree_model_iter_n_children(model, &parent) != 2)
-		return;
-	
-	GtkTreeIter child;
-	gtk_tree_model_iter_children(model, &child, &parent);
-	
-	do
-	{
-		gchar *content_type;
-		gtk_tree_model_get(model, &child, GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, &content_type, -1);
-		
-		if (!content_type)
-		{
-			gtk_tree_store_remove(tree->priv->store, &child);
-			break;
-		}
-		g_free(content_type);
-	} while (gtk_tree_model_iter_next(model, &child));
-}
-
-static void
-append_node(GitgRevisionTreeView *tree, gchar *line)
-{
-	GtkTreeIter parent;
-	GtkTreeIter iter;
-	
-	if (tree->priv->load_path)
-	{
-		gtk_tree_model_get_iter(GTK_TREE_MODEL(tree->priv->store), &parent, tree->priv->load_path);
-		gtk_tree_store_append(tree->priv->store, &iter, &parent);
-	}
-	else
-	{
-		gtk_tree_store_append(tree->priv->store, &iter, NULL);
-	}
-	
-	int len = strlen(line);
-	gboolean isdir = FALSE;
-	
-	if (line[len - 1] == '/')
-	{
-		isdir = TRUE;
-		line[len - 1] = '\0';
-	}
-	
-	GIcon *icon;
-	
-	if (isdir)
-	{
-		GtkTreeIter empty;
-		gtk_tree_store_append(tree->priv->store, &empty, &iter);
-		gtk_tree_store_set(tree->priv->store, &empty, GITG_REVISION_TREE_STORE_NAME_COLUMN, _("(Empty)"), -1);
-		
-		gchar *content_type = get_content_type(line, TRUE);
-		gtk_tree_store_set(tree->priv->store, &iter, GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, content_type, -1);
-		icon = g_content_type_get_icon(content_type);
-		g_free(content_type);
-
-		if (icon && G_IS_THEMED_ICON(icon))
-			g_themed_icon_append_name(G_THEMED_ICON(icon), "folder");
-	}
-	else
-	{
-		gchar *content_type = get_content_type(line, FALSE);
-		icon = g_content_type_get_icon(content_type);
-		gtk_tree_store_set(tree->priv->store, &iter, GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, content_type, -1);
-		g_free(content_type);
-		
-		if (icon && G_IS_THEMED_ICON(icon))
-			g_themed_icon_append_name(G_THEMED_ICON(icon), "text-x-generic");
-	}
+	if (icon && G_IS_THEMED_ICON(icon))
+		g_themed_icon_append_name(G_THEMED_ICON(icon), dir ? "folder" : "text-x-generic");
 
 	if (G_IS_THEMED_ICON(icon))
 	{
@@ -515,18 +439,13 @@ append_node(GitgRevisionTreeView *tree, gchar *line)
 		if (info)
 		{
 			GError *error = NULL;
-			GdkPixbuf *pixbuf = gtk_icon_info_load_icon(info, &error);
+			pixbuf = gtk_icon_info_load_icon(info, &error);
 			
 			if (!pixbuf)
 			{
 				g_warning("Error loading icon: %s", error->message);
 				g_error_free(error);
 			}
-		
-			gtk_tree_store_set(tree->priv->store, &iter, GITG_REVISION_TREE_STORE_ICON_COLUMN, pixbuf, -1);
-		
-			if (pixbuf)
-				g_object_unref(pixbuf);
 				
 			gtk_icon_info_free(info);
 		}
@@ -536,37 +455,183 @@ append_node(GitgRevisionTreeView *tree, gchar *line)
 	
 	if (icon)
 		g_object_unref(icon);
+	
+	return pixbuf;
+}
 
-	gtk_tree_store_set(tree->priv->store, &iter, GITG_REVISION_TREE_STORE_NAME_COLUMN, line, -1);
-	remove_dummy(tree);
+static void
+tree_clear(GitgRevisionTreeView *tree)
+{
+	TreeNode root = {0,};
+	guint index = 0;
+	
+	root.is_dir = TRUE;
+	
+	g_array_set_size(tree->priv->nodes, 0);
+	g_array_append_val(tree->priv->nodes, root);
+	
+	/* the root has the empty path */
+	g_string_truncate(tree->priv->paths, 0);
+	g_string_append_c(tree->priv->paths, '\0');
+	
+	g_array_set_size(tree->priv->stack, 0);
+	g_array_append_val(tree->priv->stack, index);
 }
 
+/* Adds an entry of git ls-tree -r -t -l, which lists every tree before its
+   contents, so the parent of an entry is the last tree seen at its depth */
 static void
-on_update(GitgRunner *runner, gchar **buffer, GitgRevisionTreeView *tree)
+add_entry(GitgRevisionTreeView *tree, gchar *line)
 {
-	gchar *line;
-	gboolean skip = TRUE;
+	gchar type[16];
+	gchar size[32];
+	gchar *tab = strchr(line, '\t');
 	
-	while ((line = *buffer++))
+	if (!tab)
+		return;
+	
+	*tab = '\0';
+	
+	if (sscanf(line, "%*s %15s %*s %31s", type, size) != 2)
+		return;
+	
+	gchar *path = tab + 1;
+	gchar *unquoted = NULL;
+	gint len = strlen(path);
+	
+	/* paths with special characters are quoted C style */
+	if (len >= 2 && path[0] == '"' && path[len - 1] == '"')
 	{
-		if (skip)
-		{
-			if (*line == '\0')
-				skip = FALSE;
-			
-			continue;
-		}
+		path[len - 1] = '\0';
+		path = unquoted = g_strcompress(path + 1);
+		len = strlen(path);
+	}
+	
+	guint depth = 0;
+	gchar *ptr;
+	
+	for (ptr = path; *ptr; ++ptr)
+		depth += *ptr == '/';
+	
+	if (depth < tree->priv->stack->len)
+	{
+		guint parent = g_array_index(tree->priv->stack, guint, depth);
+		guint index = tree->priv->nodes->len;
+		gchar *slash = strrchr(path, '/');
+		TreeNode node = {0,};
+		
+		g_array_set_size(tree->priv->stack, depth + 1);
 		
-		append_node(tree, line);
+		node.path = tree->priv->paths->len;
+		node.name = node.path + (slash ? slash - path + 1 : 0);
+		node.is_dir = strcmp(type, "tree") == 0;
+		node.size = node.is_dir ? 0 : g_ascii_strtoull(size, NULL, 10);
+		
+		g_string_append_len(tree->priv->paths, path, len + 1);
+		
+		/* children end up in reverse order, the store sorts them */
+		node.next = get_node(tree, parent)->first_child;
+		get_node(tree, parent)->first_child = index;
+		
+		g_array_append_val(tree->priv->nodes, node);
+		
+		if (node.is_dir)
+			g_array_append_val(tree->priv->stack, index);
 	}
+	
+	g_free(unquoted);
+}
+
+static void
+append_node(GitgRevisionTreeView *tree, guint index, GtkTreeIter *parent)
+{
+	TreeNode *node = get_node(tree, index);
+	gchar const *name = tree->priv->paths->str + node->name;
+	gchar *content_type = get_content_type(name, node->is_dir);
+	GdkPixbuf *pixbuf = get_icon(content_type, node->is_dir);
+	GtkTreeIter iter;
+	
+	gtk_tree_store_append(tree->priv->store, &iter, parent);
+	gtk_tree_store_set(tree->priv->store, &iter,
+	                   GITG_REVISION_TREE_STORE_NODE_COLUMN, index,
+	                   GITG_REVISION_TREE_STORE_ICON_COLUMN, pixbuf,
+	                   GITG_REVISION_TREE_STORE_NAME_COLUMN, name,
+	                   GITG_REVISION_TREE_STORE_CONTENT_TYPE_COLUMN, content_type,
+	                   -1);
+	
+	if (pixbuf)
+		g_object_unref(pixbuf);
+	
+	g_free(content_type);
+}
+
+/* Adds the children of a directory node to the store, under parent */
+static void
+materialize(GitgRevisionTreeView *tree, guint index, GtkTreeIter *parent)
+{
+	TreeNode *node = get_node(tree, index);
+	guint child;
+	
+	if (node->materialized)
+		return;
+	
+	node->materialized = TRUE;
+	
+	for (child = node->first_child; child; child = get_node(tree, child)->next)
+		append_node(tree, child, parent);
+}
+
+/* Adds the children of the directories under parent, so that they show an
+   expander */
+static void
+materialize_children(GitgRevisionTreeView *tree, GtkTreeIter *parent)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(tree->priv->store);
+	GtkTreeIter iter;
+	
+	if (!gtk_tree_model_iter_children(model, &iter, parent))
+		return;
+	
+	do
+	{
+		guint index;
+		gtk_tree_model_get(model, &iter, GITG_REVISION_TREE_STORE_NODE_COLUMN, &index, -1);
+		
+		if (index < tree->priv->nodes->len && get_node(tree, index)->is_dir)
+			materialize(tree, index, &iter);
+	} while (gtk_tree_model_iter_next(model, &iter));
+}
+
+static void
+on_update(GitgRunner *runner, gchar **buffer, GitgRevisionTreeView *tree)
+{
+	gchar *line;
+	
+	while ((line = *buffer++))
+		add_entry(tree, line);
+}
+
+static void
+on_end_loading(GitgRunner *runner, GitgRevisionTreeView *tree)
+{
+	/* cancelled loads are not shown */
+	if (!tree->priv->loading)
+		return;
+	
+	tree->priv->loading = FALSE;
+	
+	materialize(tree, 0, NULL);
+	materialize_children(tree, NULL);
 }
 
 static gint
 compare_func(GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, GitgRevisionTreeView *self)
 {
 	// First sort directories before files
-	gboolean da = gtk_tree_model_iter_has_child(model, a) != 0;
-	gboolean db = gtk_tree_model_iter_has_child(model, b) != 0;
+	TreeNode *na = get_iter_node(self, model, a);
+	TreeNode *nb = get_iter_node(self, model, b);
+	gboolean da = na && na->is_dir;
+	gboolean db = nb && nb->is_dir;
 	
 	if (da != db)
 		return da ? -1 : 1;
@@ -629,48 +694,19 @@ gitg_revision_tree_view_init(GitgRevisionTreeView *self)
 	gtk_tree_sortable_set_sort_func(GTK_TREE_SORTABLE(self->priv->store), 1, (GtkTreeIterCompareFunc)compare_func, self, NULL);
 	gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(self->priv->store), 1, GTK_SORT_ASCENDING);
 		
-	self->priv->loader = gitg_runner_new(1000);
+	self->priv->nodes = g_array_new(FALSE, FALSE, sizeof(TreeNode));
+	self->priv->paths = g_string_new("");
+	self->priv->stack = g_array_new(FALSE, FALSE, sizeof(guint));
+	tree_clear(self);
+	
+	self->priv->loader = gitg_runner_new(4096);
 	g_signal_connect(self->priv->loader, "update", G_CALLBACK(on_update), self);
+	g_signal_connect(self->priv->loader, "end-loading", G_CALLBACK(on_end_loading), self);
 	
 	self->priv->content_runner = gitg_runner_new(5000);
 	g_signal_connect(self->priv->content_runner, "update", G_CALLBACK(on_contents_update), self);
 }
 
-static gchar *
-node_identity(GitgRevisionTreeView *tree, GtkTreeIter *parent)
-{
-	gchar *sha = gitg_revision_get_sha1(tree->priv->revision);
-	
-	// Path consists of the SHA1 of the revision and the actual file path
-	// from parent
-	gchar *par = node_path(GTK_TREE_MODEL(tree->priv->store), parent);
-	gchar *path = g_strconcat(sha, ":", par, NULL);
-	g_free(sha);
-	g_free(par);
-	
-	return path;
-}
-
-static void
-load_node(GitgRevisionTreeView *tree, GtkTreeIter *parent)
-{
-	if (gitg_runner_running(tree->priv->loader))
-		return;
-	
-	if (tree->priv->load_path)
-		gtk_tree_path_free(tree->priv->load_path);
-	
-	gchar *id = node_identity(tree, parent);
-
-	if (parent)
-		tree->priv->load_path = gtk_tree_model_get_path(GTK_TREE_MODEL(tree->priv->store), parent);	
-	else
-		tree->priv->load_path = NULL;
-
-	gitg_repository_run_commandv(tree->priv->repository, tree->priv->loader, NULL, "show", id, NULL);
-	g_free(id);
-}
-
 GitgRevisionTreeView *
 gitg_revision_tree_view_new()
 {
@@ -691,11 +727,25 @@ gitg_revision_tree_view_reload(GitgRevisionTreeView *tree)
 {
 	g_return_if_fail(GITG_IS_REVISION_TREE_VIEW(tree));
 	
+	tree->priv->loading = FALSE;
+	tree->priv->load_pending = FALSE;
 	gitg_runner_cancel(tree->priv->loader);
+	
 	gtk_tree_store_clear(tree->priv->store);
+	tree_clear(tree);
 	
 	if (!(tree->priv->repository && tree->priv->revision))
 		return;
 	
-	load_node(tree, NULL);
+	/* hidden views load when they are shown */
+	if (!GTK_WIDGET_MAPPED(tree))
+	{
+		tree->priv->load_pending = TRUE;
+		return;
+	}
+	
+	/* the whole tree at once, with the sizes of the files */
+	gchar *sha = gitg_revision_get_sha1(tree->priv->revision);
+	tree->priv->loading = gitg_repository_run_commandv(tree->priv->repository, tree->priv->loader, NULL, "ls-tree", "-r", "-t", "-l", sha, NULL);
+	g_free(sha);
 }
@@ -2,21 +2,85 @@
 #include <gtksourceview/gtksourcelanguagemanager.h>
 #include <gtksourceview/gtksourcestyleschememanager.h>
 #include <string.h>
+#include <glib/gi18n.h>
 
 #include "gitg-revision-view.h"
 #include "gitg-revision.h"
 #include "gitg-runner.h"
 #include "gitg-utils.h"
+#include "gitg-diff-side-view.h"
 
 #define GITG_REVISION_VIEW_GET_PRIVATE(object)(G_TYPE_INSTANCE_GET_PRIVATE((object), GITG_TYPE_REVISION_VIEW, GitgRevisionViewPrivate))
 
+/* diff text is inserted in blocks from an idle handler, which stops after
+   INSERT_BUDGET seconds to let the view redraw */
+#define INSERT_BLOCK_SIZE (64 * 1024)
+#define INSERT_BUDGET 0.01
+
+/* loaded diffs are kept by hash, most recently used first */
+#define DIFF_CACHE_SIZE (32 * 1024 * 1024)
+#define DIFF_CACHE_MAX_ENTRY (4 * 1024 * 1024)
+#define PREFETCH_NUM 2
+
+/* commits changing more are shown as a list of files, loading the changes
+   of a file when it is scrolled into view or clicked */
+#define LAZY_DIFF_LINES 20000
+#define LAZY_DIFF_FILES 100
+
 /* Properties */
 enum
 {
 	PROP_0,
-	PROP_REPOSITORY
+	PROP_REPOSITORY,
+	PROP_MAX_DIFF_SIZE,
+	PROP_MAX_DIFF_LINES
 };
 
+typedef struct
+{
+	Hash hash;
+	gchar *text;
+	gsize size;
+} DiffCacheEntry;
+
+/* git show prints the message, a line with \01, the --numstat summary and
+   then the patch */
+typedef enum
+{
+	DIFF_STATE_MESSAGE,
+	DIFF_STATE_SUMMARY,
+	DIFF_STATE_PATCH
+} DiffState;
+
+typedef enum
+{
+	FILE_STATE_PENDING,
+	FILE_STATE_QUEUED,
+	FILE_STATE_LOADED
+} FileState;
+
+typedef struct
+{
+	gchar *path;
+	
+	/* path before a rename, NULL when not renamed */
+	gchar *old_path;
+	guint added;
+	guint removed;
+	gboolean binary;
+	
+	/* start of the placeholder line of a lazily loaded file */
+	GtkTextMark *mark;
+	FileState state;
+} DiffFile;
+
+typedef struct
+{
+	DiffState state;
+	GPtrArray *files;
+	guint changes;
+} DiffSummary;
+
 /* Signals */
 enum
 {
@@ -34,9 +98,59 @@ struct _GitgRevisionViewPrivate
 	GtkLabel *subject;
 	GtkTable *parents;
 	GtkSourceView *diff;
+	GtkWidget *load_remaining;
+	
+	/* shows the buffer of diff, in place of its scrolled window */
+	GtkWidget *diff_side;
+	gboolean side_by_side;
 	
 	GitgRunner *diff_runner;
 	
+	/* diff text read, inserted up to diff_offset */
+	GString *diff_pending;
+	gsize diff_offset;
+	guint diff_idle_id;
+	Hash diff_hash;
+	DiffSummary diff_summary;
+	
+	/* files of a large commit */
+	gboolean diff_lazy;
+	GitgRunner *file_runner;
+	GString *file_text;
+	DiffFile *file_loading;
+	gboolean file_truncated;
+	GQueue *file_queue;
+	guint visible_idle_id;
+	
+	GQueue *diff_cache;
+	GHashTable *diff_cache_index;
+	gsize diff_cache_size;
+	
+	/* diffs of the neighbouring revisions, loaded after the shown one */
+	GitgRunner *prefetch_runner;
+	GString *prefetch_text;
+	DiffSummary prefetch_summary;
+	Hash prefetch_queue[PREFETCH_NUM];
+	guint prefetch_num;
+	Hash prefetch_hash;
+	guint prefetch_idle_id;
+	
+	/* inserted so far, limited by max_diff_size and max_diff_lines unless
+	   the user asked for the remaining text */
+	gsize diff_size;
+	guint diff_lines;
+	gboolean diff_capped;
+	gboolean diff_unlimited;
+	
+	/* git show is stopped once the limits are reached, and run again for
+	   the remaining text with diff_discard bytes already shown */
+	guint diff_read_lines;
+	gboolean diff_stopped;
+	gsize diff_discard;
+	
+	guint max_diff_size;
+	guint max_diff_lines;
+	
 	GitgRepository *repository;
 };
 
@@ -47,6 +161,10 @@ G_DEFINE_TYPE_EXTENDED(GitgRevisionView, gitg_revision_view, GTK_TYPE_VBOX, 0,
 
 static GtkBuildableIface parent_iface;
 
+static void on_load_remaining_clicked(GtkButton *button, GitgRevisionView *self);
+static void on_diff_scrolled(GtkAdjustment *adjustment, GitgRevisionView *self);
+static gboolean on_diff_button_press(GtkWidget *widget, GdkEventButton *event, GitgRevisionView *self);
+
 static void
 update_markup(GObject *object)
 {
@@ -85,6 +203,41 @@ gitg_revision_view_parser_finished(GtkBuildable *buildable, GtkBuilder *builder)
 	
 	gitg_utils_set_monospace_font(GTK_WIDGET(rvv->priv->diff));
 	gtk_text_view_set_buffer(GTK_TEXT_VIEW(rvv->priv->diff), GTK_TEXT_BUFFER(buffer));
+	
+	/* shown when a diff is larger than the configured limits */
+	rvv->priv->load_remaining = gtk_button_new();
+	gtk_widget_set_no_show_all(rvv->priv->load_remaining, TRUE);
+	gtk_box_pack_end(GTK_BOX(rvv), rvv->priv->load_remaining, FALSE, FALSE, 0);
+	g_signal_connect(rvv->priv->load_remaining, "clicked", G_CALLBACK(on_load_remaining_clicked), rvv);
+	
+	/* files of large commits load when they become visible or are clicked */
+	GtkWidget *scrolled = gtk_widget_get_parent(GTK_WIDGET(rvv->priv->diff));
+	
+	if (GTK_IS_SCROLLED_WINDOW(scrolled))
+	{
+		GtkAdjustment *adjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled));
+		
+		g_signal_connect(adjustment, "value-changed", G_CALLBACK(on_diff_scrolled), rvv);
+		g_signal_connect(adjustment, "changed", G_CALLBACK(on_diff_scrolled), rvv);
+	}
+	
+	g_signal_connect(rvv->priv->diff, "button-press-event", G_CALLBACK(on_diff_button_press), rvv);
+	
+	/* the side by side view is packed next to the unified one, hidden */
+	rvv->priv->diff_side = gitg_diff_side_view_new(GITG_DIFF_VIEW(rvv->priv->diff));
+	GtkWidget *box = gtk_widget_get_parent(scrolled);
+	
+	/* not shown with the rest of the window */
+	gtk_widget_set_no_show_all(rvv->priv->diff_side, TRUE);
+	
+	if (GTK_IS_BOX(box))
+	{
+		gint position;
+		
+		gtk_container_child_get(GTK_CONTAINER(box), scrolled, "position", &position, NULL);
+		gtk_box_pack_start(GTK_BOX(box), rvv->priv->diff_side, TRUE, TRUE, 0);
+		gtk_box_reorder_child(GTK_BOX(box), rvv->priv->diff_side, position + 1);
+	}
 
 	gchar const *lbls[] = {
 		"label_subject_lbl",
@@ -107,6 +260,244 @@ gitg_revision_view_buildable_iface_init(GtkBuildableIface *iface)
 	iface->parser_finished = gitg_revision_view_parser_finished;
 }
 
+static void
+summary_reset(DiffSummary *summary, GtkTextBuffer *buffer)
+{
+	guint i;
+	
+	for (i = 0; i < summary->files->len; ++i)
+	{
+		DiffFile *file = (DiffFile *)g_ptr_array_index(summary->files, i);
+		
+		if (file->mark && buffer)
+			gtk_text_buffer_delete_mark(buffer, file->mark);
+		
+		g_free(file->path);
+		g_free(file->old_path);
+		g_slice_free(DiffFile, file);
+	}
+	
+	g_ptr_array_set_size(summary->files, 0);
+	summary->state = DIFF_STATE_MESSAGE;
+	summary->changes = 0;
+}
+
+static gboolean
+is_number(gchar const *s)
+{
+	return *s && strspn(s, "0123456789") == strlen(s);
+}
+
+static gchar *
+unquote_path(gchar const *path, gsize len)
+{
+	/* paths with special characters are quoted C style */
+	if (len >= 2 && path[0] == '"' && path[len - 1] == '"')
+	{
+		gchar *quoted = g_strndup(path + 1, len - 2);
+		gchar *ret = g_strcompress(quoted);
+		
+		g_free(quoted);
+		return ret;
+	}
+	
+	return g_strndup(path, len);
+}
+
+/* the path part of a rename before or after the arrow, with the parts
+   around the braces. An empty part takes the separator after it along */
+static gchar *
+join_rename(gchar const *path, gchar const *open, gchar const *part, gsize len, gchar const *close)
+{
+	gchar const *suffix = close + 1;
+	
+	if (len == 0 && *suffix == '/')
+		++suffix;
+	
+	gchar *prefix = g_strndup(path, open - path);
+	gchar *middle = g_strndup(part, len);
+	gchar *ret = g_strconcat(prefix, middle, suffix, NULL);
+	
+	g_free(prefix);
+	g_free(middle);
+	
+	return ret;
+}
+
+/* renames are summarized as old => new, or as pre{old => new}post when
+   the paths have parts in common */
+static void
+parse_paths(DiffFile *file, gchar const *path)
+{
+	gchar const *arrow = strstr(path, " => ");
+	
+	if (!arrow)
+	{
+		file->path = unquote_path(path, strlen(path));
+		return;
+	}
+	
+	gchar const *open = strchr(path, '{');
+	gchar const *close = strchr(arrow, '}');
+	
+	if (open && open < arrow && close)
+	{
+		file->old_path = join_rename(path, open, open + 1, arrow - open - 1, close);
+		file->path = join_rename(path, open, arrow + 4, close - arrow - 4, close);
+	}
+	else
+	{
+		file->old_path = unquote_path(path, arrow - path);
+		file->path = unquote_path(arrow + 4, strlen(arrow + 4));
+	}
+}
+
+static DiffFile *
+parse_numstat(gchar const *line)
+{
+	gchar **parts = g_strsplit(line, "\t", 3);
+	DiffFile *file = NULL;
+	
+	if (g_strv_length(parts) == 3 && ((is_number(parts[0]) && is_number(parts[1])) ||
+	                                  (strcmp(parts[0], "-") == 0 && strcmp(parts[1], "-") == 0)))
+	{
+		file = g_slice_new0(DiffFile);
+		parse_paths(file, parts[2]);
+		
+		file->binary = *parts[0] == '-';
+		file->added = atoi(parts[0]);
+		file->removed = atoi(parts[1]);
+	}
+	
+	g_strfreev(parts);
+	return file;
+}
+
+/* adds a line of git show output to out, returns TRUE without consuming the
+   line when it ends the summary */
+static gboolean
+summary_add_line(DiffSummary *summary, gchar const *line, GString *out)
+{
+	DiffFile *file;
+	
+	switch (summary->state)
+	{
+		case DIFF_STATE_MESSAGE:
+			if (strcmp(line, "\01") == 0)
+			{
+				summary->state = DIFF_STATE_SUMMARY;
+				return FALSE;
+			}
+		break;
+		case DIFF_STATE_SUMMARY:
+			if (!*line && summary->files->len == 0)
+				return FALSE;
+			
+			if ((file = parse_numstat(line)))
+			{
+				g_ptr_array_add(summary->files, file);
+				summary->changes += file->added + file->removed;
+				return FALSE;
+			}
+			
+			summary->state = DIFF_STATE_PATCH;
+		return TRUE;
+		case DIFF_STATE_PATCH:
+		break;
+	}
+	
+	g_string_append(out, line);
+	g_string_append_c(out, '\n');
+	
+	return FALSE;
+}
+
+static gboolean
+summary_is_large(DiffSummary *summary)
+{
+	return summary->files->len > LAZY_DIFF_FILES || summary->changes > LAZY_DIFF_LINES;
+}
+
+static void
+format_file(DiffFile *file, GString *out)
+{
+	if (file->old_path)
+		g_string_append_printf(out, "%s => ", file->old_path);
+	
+	if (file->binary)
+		g_string_append_printf(out, "%s | %s\n", file->path, _("binary"));
+	else
+		g_string_append_printf(out, "%s | +%u -%u\n", file->path, file->added, file->removed);
+}
+
+static void
+summary_format(DiffSummary *summary, GString *out)
+{
+	guint i;
+	
+	for (i = 0; i < summary->files->len; ++i)
+		format_file((DiffFile *)g_ptr_array_index(summary->files, i), out);
+	
+	summary->state = DIFF_STATE_PATCH;
+}
+
+static void
+free_cache_entry(DiffCacheEntry *entry)
+{
+	g_free(entry->text);
+	g_slice_free(DiffCacheEntry, entry);
+}
+
+static void
+cache_clear(GitgRevisionView *self)
+{
+	g_hash_table_remove_all(self->priv->diff_cache_index);
+	g_queue_foreach(self->priv->diff_cache, (GFunc)free_cache_entry, NULL);
+	g_queue_clear(self->priv->diff_cache);
+	
+	self->priv->diff_cache_size = 0;
+}
+
+static DiffCacheEntry *
+cache_lookup(GitgRevisionView *self, gchar const *hash)
+{
+	GList *link = (GList *)g_hash_table_lookup(self->priv->diff_cache_index, hash);
+	
+	if (!link)
+		return NULL;
+	
+	g_queue_unlink(self->priv->diff_cache, link);
+	g_queue_push_head_link(self->priv->diff_cache, link);
+	
+	return (DiffCacheEntry *)link->data;
+}
+
+static void
+cache_add(GitgRevisionView *self, gchar const *hash, gchar const *text, gsize size)
+{
+	if (size > DIFF_CACHE_MAX_ENTRY || g_hash_table_lookup(self->priv->diff_cache_index, hash))
+		return;
+	
+	DiffCacheEntry *entry = g_slice_new(DiffCacheEntry);
+	
+	memcpy(entry->hash, hash, sizeof(Hash));
+	entry->text = g_memdup(text, size);
+	entry->size = size;
+	
+	g_queue_push_head(self->priv->diff_cache, entry);
+	g_hash_table_insert(self->priv->diff_cache_index, entry->hash, self->priv->diff_cache->head);
+	self->priv->diff_cache_size += size;
+	
+	while (self->priv->diff_cache_size > DIFF_CACHE_SIZE)
+	{
+		DiffCacheEntry *last = (DiffCacheEntry *)g_queue_pop_tail(self->priv->diff_cache);
+		
+		g_hash_table_remove(self->priv->diff_cache_index, last->hash);
+		self->priv->diff_cache_size -= last->size;
+		free_cache_entry(last);
+	}
+}
+
 static void
 gitg_revision_view_finalize(GObject *object)
 {
@@ -115,7 +506,39 @@ gitg_revision_view_finalize(GObject *object)
 	gitg_runner_cancel(self->priv->diff_runner);
 	g_object_unref(self->priv->diff_runner);
 	
-	g_object_unref(self->priv->repository);
+	if (self->priv->diff_idle_id)
+		g_source_remove(self->priv->diff_idle_id);
+
+	g_string_free(self->priv->diff_pending, TRUE);
+	
+	self->priv->prefetch_num = 0;
+	gitg_runner_cancel(self->priv->prefetch_runner);
+	g_object_unref(self->priv->prefetch_runner);
+	g_string_free(self->priv->prefetch_text, TRUE);
+	
+	if (self->priv->prefetch_idle_id)
+		g_source_remove(self->priv->prefetch_idle_id);
+	
+	self->priv->file_loading = NULL;
+	gitg_runner_cancel(self->priv->file_runner);
+	g_object_unref(self->priv->file_runner);
+	g_string_free(self->priv->file_text, TRUE);
+	g_queue_free(self->priv->file_queue);
+	
+	if (self->priv->visible_idle_id)
+		g_source_remove(self->priv->visible_idle_id);
+	
+	summary_reset(&self->priv->diff_summary, NULL);
+	summary_reset(&self->priv->prefetch_summary, NULL);
+	g_ptr_array_free(self->priv->diff_summary.files, TRUE);
+	g_ptr_array_free(self->priv->prefetch_summary.files, TRUE);
+	
+	cache_clear(self);
+	g_queue_free(self->priv->diff_cache);
+	g_hash_table_destroy(self->priv->diff_cache_index);
+	
+	if (self->priv->repository)
+		g_object_unref(self->priv->repository);
 
 	G_OBJECT_CLASS(gitg_revision_view_parent_class)->finalize(object);
 }
@@ -130,6 +553,12 @@ gitg_revision_view_get_property(GObject *object, guint prop_id, GValue *value, G
 		case PROP_REPOSITORY:
 			g_value_set_object(value, self->priv->repository);
 		break;
+		case PROP_MAX_DIFF_SIZE:
+			g_value_set_uint(value, self->priv->max_diff_size);
+		break;
+		case PROP_MAX_DIFF_LINES:
+			g_value_set_uint(value, self->priv->max_diff_lines);
+		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -151,6 +580,12 @@ gitg_revision_view_set_property(GObject *object, guint prop_id, const GValue *va
 			self->priv->repository = g_value_dup_object(value);
 		}
 		break;
+		case PROP_MAX_DIFF_SIZE:
+			self->priv->max_diff_size = g_value_get_uint(value);
+		break;
+		case PROP_MAX_DIFF_LINES:
+			self->priv->max_diff_lines = g_value_get_uint(value);
+		break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -175,6 +610,24 @@ gitg_revision_view_class_init(GitgRevisionViewClass *klass)
 							      GITG_TYPE_REPOSITORY,
 							      G_PARAM_READWRITE));
 
+	g_object_class_install_property(object_class, PROP_MAX_DIFF_SIZE,
+					 g_param_spec_uint("max-diff-size",
+							      "MAX_DIFF_SIZE",
+							      "Number of bytes of a diff shown before asking, 0 for no limit",
+							      0,
+							      G_MAXUINT,
+							      2 * 1024 * 1024,
+							      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+	g_object_class_install_property(object_class, PROP_MAX_DIFF_LINES,
+					 g_param_spec_uint("max-diff-lines",
+							      "MAX_DIFF_LINES",
+							      "Number of lines of a diff shown before asking, 0 for no limit",
+							      0,
+							      G_MAXUINT,
+							      50000,
+							      G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
 	signals[PARENT_ACTIVATED] =
 		g_signal_new("parent-activated",
 			G_OBJECT_CLASS_TYPE (object_class),
@@ -196,26 +649,564 @@ on_diff_begin_loading(GitgRunner *runner, GitgRevisionView *self)
 	gdk_cursor_unref(cursor);
 }
 
+static gboolean on_prefetch_idle(GitgRevisionView *self);
+static void schedule_insert(GitgRevisionView *self);
+
+static void
+schedule_prefetch(GitgRevisionView *self)
+{
+	if (!self->priv->prefetch_idle_id && self->priv->prefetch_num)
+		self->priv->prefetch_idle_id = g_idle_add_full(G_PRIORITY_LOW, (GSourceFunc)on_prefetch_idle, self, NULL);
+}
+
 static void
 on_diff_end_loading(GitgRunner *runner, GitgRevisionView *self)
 {
 	gdk_window_set_cursor(GTK_WIDGET(self->priv->diff)->window, NULL);
+	
+	/* the runner was not cancelled, and the text is complete */
+	if (gitg_runner_get_exit_status(runner) == 0 && !self->priv->diff_unlimited)
+	{
+		/* commits without a patch end in the summary */
+		if (self->priv->diff_summary.state == DIFF_STATE_SUMMARY)
+		{
+			summary_format(&self->priv->diff_summary, self->priv->diff_pending);
+			schedule_insert(self);
+		}
+		
+		cache_add(self, self->priv->diff_hash, self->priv->diff_pending->str, self->priv->diff_pending->len);
+	}
+	
+	schedule_prefetch(self);
 }
 
 static void
-on_diff_update(GitgRunner *runner, gchar **buffer, GitgRevisionView *self)
+run_show(GitgRevisionView *self, GitgRunner *runner, GitgRepository *repository, gchar const *hash, gchar const *path, gchar const *old_path)
+{
+	gchar *sha = gitg_utils_hash_to_sha1_new(hash);
+	gchar *gitpath = gitg_utils_dot_git_path(gitg_repository_get_path(repository));
+	
+	/* the patch of a single file, or everything after a summary. A renamed
+	   file is limited to both of its paths, so the rename is detected */
+	gchar const *argv[] = {
+		"git",
+		"--git-dir",
+		gitpath,
+		"show",
+		path ? "--pretty=format:" : "--pretty=format:%s%n%n%b%n%x01",
+		"--encoding=UTF-8",
+		path ? "--no-color" : "--numstat",
+		"-p",
+		sha,
+		"--",
+		path,
+		old_path,
+		NULL
+	};
+	
+	gitg_runner_run(runner, argv, NULL);
+
+	g_free(sha);
+	g_free(gitpath);
+}
+
+static gboolean
+on_prefetch_idle(GitgRevisionView *self)
+{
+	self->priv->prefetch_idle_id = 0;
+	
+	/* the shown diff goes first, its end restarts prefetching */
+	if (gitg_runner_running(self->priv->diff_runner) || gitg_runner_running(self->priv->prefetch_runner))
+		return FALSE;
+	
+	while (self->priv->prefetch_num && self->priv->repository)
+	{
+		memcpy(self->priv->prefetch_hash, self->priv->prefetch_queue[0], sizeof(Hash));
+		memmove(self->priv->prefetch_queue, self->priv->prefetch_queue + 1, --self->priv->prefetch_num * sizeof(Hash));
+		
+		if (g_hash_table_lookup(self->priv->diff_cache_index, self->priv->prefetch_hash))
+			continue;
+		
+		g_string_truncate(self->priv->prefetch_text, 0);
+		summary_reset(&self->priv->prefetch_summary, NULL);
+		run_show(self, self->priv->prefetch_runner, self->priv->repository, self->priv->prefetch_hash, NULL, NULL);
+		break;
+	}
+	
+	return FALSE;
+}
+
+static void
+on_prefetch_update(GitgRunner *runner, gchar **buffer, GitgRevisionView *self)
+{
+	gchar *line;
+	
+	DiffSummary *summary = &self->priv->prefetch_summary;
+	
+	while ((line = *buffer++))
+	{
+		if (!summary_add_line(summary, line, self->priv->prefetch_text))
+			continue;
+		
+		/* large commits are not cached, they are loaded per file */
+		if (summary_is_large(summary))
+		{
+			gitg_runner_cancel(runner);
+			return;
+		}
+		
+		summary_format(summary, self->priv->prefetch_text);
+		summary_add_line(summary, line, self->priv->prefetch_text);
+	}
+	
+	/* too large to be cached anyway */
+	if (self->priv->prefetch_text->len > DIFF_CACHE_MAX_ENTRY)
+		gitg_runner_cancel(runner);
+}
+
+static void
+on_prefetch_end_loading(GitgRunner *runner, GitgRevisionView *self)
+{
+	if (gitg_runner_get_exit_status(runner) == 0)
+	{
+		if (self->priv->prefetch_summary.state == DIFF_STATE_SUMMARY)
+			summary_format(&self->priv->prefetch_summary, self->priv->prefetch_text);
+		
+		cache_add(self, self->priv->prefetch_hash, self->priv->prefetch_text->str, self->priv->prefetch_text->len);
+	}
+	
+	g_string_truncate(self->priv->prefetch_text, 0);
+	schedule_prefetch(self);
+}
+
+static void
+queue_prefetch(GitgRevisionView *self, GitgRepository *repository, GitgRevision *revision)
+{
+	GtkTreeIter iter;
+	
+	self->priv->prefetch_num = 0;
+	
+	if (!gitg_repository_find(repository, revision, &iter))
+		return;
+	
+	/* next row first, moving down is the common direction */
+	gint row = gitg_repository_get_row(repository, &iter);
+	gint rows[] = {row + 1, row - 1};
+	guint i;
+	
+	for (i = 0; i < PREFETCH_NUM; ++i)
+	{
+		gchar const *hash = rows[i] >= 0 ? gitg_repository_peek_hash(repository, rows[i]) : NULL;
+		
+		if (hash)
+			memcpy(self->priv->prefetch_queue[self->priv->prefetch_num++], hash, sizeof(Hash));
+	}
+}
+
+static void
+update_load_remaining(GitgRevisionView *self)
+{
+	gsize remaining = self->priv->diff_pending->len - self->priv->diff_offset;
+	gchar *label;
+	
+	/* the size of the rest is not known when git show was stopped */
+	if (self->priv->diff_stopped)
+		label = g_strdup(_("Load remaining changes"));
+	else
+		label = g_strdup_printf(_("Load remaining %.1f MB"), remaining / (1024.0 * 1024.0));
+	
+	gtk_button_set_label(GTK_BUTTON(self->priv->load_remaining), label);
+	gtk_widget_show(self->priv->load_remaining);
+	
+	g_free(label);
+}
+
+/* number of bytes of complete lines that can be inserted in one block */
+static gsize
+next_block(GitgRevisionView *self, guint *lines)
+{
+	gchar const *start = self->priv->diff_pending->str + self->priv->diff_offset;
+	gchar const *end = self->priv->diff_pending->str + self->priv->diff_pending->len;
+	gchar const *ptr = start;
+	gsize max_size = INSERT_BLOCK_SIZE;
+	guint max_lines = G_MAXUINT;
+	
+	if (!self->priv->diff_unlimited)
+	{
+		if (self->priv->max_diff_size)
+			max_size = MIN(max_size, self->priv->max_diff_size - MIN(self->priv->diff_size, self->priv->max_diff_size));
+		
+		if (self->priv->max_diff_lines)
+			max_lines = self->priv->max_diff_lines - MIN(self->priv->diff_lines, self->priv->max_diff_lines);
+	}
+	
+	*lines = 0;
+	
+	while (ptr < end && *lines < max_lines && ptr - start < max_size)
+	{
+		gchar const *newline = memchr(ptr, '\n', end - ptr);
+		
+		if (!newline)
+			break;
+		
+		ptr = newline + 1;
+		++*lines;
+	}
+	
+	return ptr - start;
+}
+
+static gboolean
+on_diff_idle_insert(GitgRevisionView *self)
+{
+	GtkTextBuffer *buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(self->priv->diff));
+	GTimer *timer = g_timer_new();
+	gboolean ret = TRUE;
+	GtkTextIter iter;
+	
+	while (g_timer_elapsed(timer, NULL) < INSERT_BUDGET)
+	{
+		guint lines;
+		gsize size = next_block(self, &lines);
+		
+		if (size == 0)
+		{
+			/* out of text, or over the limits */
+			if (self->priv->diff_offset < self->priv->diff_pending->len)
+			{
+				self->priv->diff_capped = TRUE;
+				update_load_remaining(self);
+			}
+			
+			ret = FALSE;
+			break;
+		}
+		
+		gtk_text_buffer_get_end_iter(buf, &iter);
+		gtk_text_buffer_insert(buf, &iter, self->priv->diff_pending->str + self->priv->diff_offset, size);
+		
+		self->priv->diff_offset += size;
+		self->priv->diff_size += size;
+		self->priv->diff_lines += lines;
+	}
+	
+	g_timer_destroy(timer);
+	
+	/* past the limits the text is not cached, drop what was inserted */
+	if (self->priv->diff_unlimited && self->priv->diff_offset)
+	{
+		g_string_erase(self->priv->diff_pending, 0, self->priv->diff_offset);
+		self->priv->diff_offset = 0;
+	}
+	
+	if (!ret)
+		self->priv->diff_idle_id = 0;
+	
+	return ret;
+}
+
+static void
+schedule_insert(GitgRevisionView *self)
+{
+	if (!self->priv->diff_idle_id && !self->priv->diff_capped)
+		self->priv->diff_idle_id = g_idle_add((GSourceFunc)on_diff_idle_insert, self);
+}
+
+static void
+load_next_file(GitgRevisionView *self)
+{
+	if (gitg_runner_running(self->priv->file_runner) || !self->priv->repository)
+		return;
+	
+	DiffFile *file = (DiffFile *)g_queue_pop_head(self->priv->file_queue);
+	
+	if (!file)
+		return;
+	
+	self->priv->file_loading = file;
+	self->priv->file_truncated = FALSE;
+	g_string_truncate(self->priv->file_text, 0);
+	
+	run_show(self, self->priv->file_runner, self->priv->repository, self->priv->diff_hash, file->path, file->old_path);
+}
+
+static void
+queue_file(GitgRevisionView *self, DiffFile *file, gboolean first)
+{
+	if (file->state != FILE_STATE_PENDING)
+		return;
+	
+	file->state = FILE_STATE_QUEUED;
+	
+	if (first)
+		g_queue_push_head(self->priv->file_queue, file);
+	else
+		g_queue_push_tail(self->priv->file_queue, file);
+	
+	load_next_file(self);
+}
+
+static void
+on_file_update(GitgRunner *runner, gchar **buffer, GitgRevisionView *self)
 {
 	gchar *line;
+	
+	while ((line = *buffer++))
+	{
+		/* skip the empty message */
+		if (!*line && self->priv->file_text->len == 0)
+			continue;
+		
+		g_string_append(self->priv->file_text, line);
+		g_string_append_c(self->priv->file_text, '\n');
+	}
+	
+	if (self->priv->max_diff_size && self->priv->file_text->len > self->priv->max_diff_size)
+	{
+		self->priv->file_truncated = TRUE;
+		gitg_runner_cancel(runner);
+	}
+}
+
+static void
+on_file_end_loading(GitgRunner *runner, GitgRevisionView *self)
+{
+	DiffFile *file = self->priv->file_loading;
+	
+	self->priv->file_loading = NULL;
+	
+	if (!file || (gitg_runner_get_exit_status(runner) != 0 && !self->priv->file_truncated))
+		return;
+	
+	/* replace the placeholder with the changes */
+	GtkTextBuffer *buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(self->priv->diff));
+	GtkTextIter start;
+	GtkTextIter end;
+	
+	gtk_text_buffer_get_iter_at_mark(buf, &start, file->mark);
+	end = start;
+	gtk_text_iter_forward_line(&end);
+	gtk_text_buffer_delete(buf, &start, &end);
+	
+	if (self->priv->file_truncated)
+		g_string_append_printf(self->priv->file_text, "%s\n", _("[the changes of this file are too large to be shown completely]"));
+	
+	gtk_text_buffer_get_iter_at_mark(buf, &start, file->mark);
+	gtk_text_buffer_insert(buf, &start, self->priv->file_text->str, self->priv->file_text->len);
+	
+	file->state = FILE_STATE_LOADED;
+	g_string_truncate(self->priv->file_text, 0);
+	
+	load_next_file(self);
+}
+
+static gboolean
+on_visible_idle(GitgRevisionView *self)
+{
+	GtkTextView *view = GTK_TEXT_VIEW(self->priv->diff);
+	GtkTextBuffer *buf = gtk_text_view_get_buffer(view);
+	GdkRectangle rect;
+	GtkTextIter iter;
+	guint i;
+	
+	self->priv->visible_idle_id = 0;
+	
+	gtk_text_view_get_visible_rect(view, &rect);
+	gtk_text_view_get_line_at_y(view, &iter, rect.y, NULL);
+	gint first = gtk_text_iter_get_line(&iter);
+	
+	gtk_text_view_get_line_at_y(view, &iter, rect.y + rect.height, NULL);
+	gint last = gtk_text_iter_get_line(&iter);
+	
+	for (i = 0; i < self->priv->diff_summary.files->len; ++i)
+	{
+		DiffFile *file = (DiffFile *)g_ptr_array_index(self->priv->diff_summary.files, i);
+		
+		if (file->state != FILE_STATE_PENDING)
+			continue;
+		
+		gtk_text_buffer_get_iter_at_mark(buf, &iter, file->mark);
+		gint line = gtk_text_iter_get_line(&iter);
+		
+		if (line > last)
+			break;
+		
+		if (line >= first)
+			queue_file(self, file, FALSE);
+	}
+	
+	return FALSE;
+}
+
+static void
+on_diff_scrolled(GtkAdjustment *adjustment, GitgRevisionView *self)
+{
+	if (self->priv->diff_lazy && !self->priv->visible_idle_id)
+		self->priv->visible_idle_id = g_idle_add((GSourceFunc)on_visible_idle, self);
+}
+
+static gboolean
+on_diff_button_press(GtkWidget *widget, GdkEventButton *event, GitgRevisionView *self)
+{
+	if (!self->priv->diff_lazy || event->button != 1)
+		return FALSE;
+	
+	GtkTextView *view = GTK_TEXT_VIEW(widget);
+	GtkTextBuffer *buf = gtk_text_view_get_buffer(view);
+	GtkTextIter iter;
+	gint x;
+	gint y;
+	guint i;
+	
+	gtk_text_view_window_to_buffer_coords(view, GTK_TEXT_WINDOW_TEXT, event->x, event->y, &x, &y);
+	gtk_text_view_get_iter_at_location(view, &iter, x, y);
+	gint clicked = gtk_text_iter_get_line(&iter);
+	
+	/* clicking the name or placeholder of a file loads it first */
+	for (i = 0; i < self->priv->diff_summary.files->len; ++i)
+	{
+		DiffFile *file = (DiffFile *)g_ptr_array_index(self->priv->diff_summary.files, i);
+		
+		if (file->state != FILE_STATE_PENDING)
+			continue;
+		
+		gtk_text_buffer_get_iter_at_mark(buf, &iter, file->mark);
+		gint line = gtk_text_iter_get_line(&iter);
+		
+		if (line == clicked || line - 1 == clicked)
+		{
+			queue_file(self, file, TRUE);
+			break;
+		}
+	}
+	
+	return FALSE;
+}
+
+static void
+show_files(GitgRevisionView *self)
+{
 	GtkTextBuffer *buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(self->priv->diff));
+	GPtrArray *files = self->priv->diff_summary.files;
+	GString *text = g_string_new("");
 	GtkTextIter iter;
+	guint i;
 	
+	/* stop loading the patch */
+	self->priv->diff_lazy = TRUE;
+	gitg_runner_cancel(self->priv->diff_runner);
+	
+	if (self->priv->diff_idle_id)
+	{
+		g_source_remove(self->priv->diff_idle_id);
+		self->priv->diff_idle_id = 0;
+	}
+	
+	/* the message */
 	gtk_text_buffer_get_end_iter(buf, &iter);
+	gtk_text_buffer_insert(buf, &iter, self->priv->diff_pending->str + self->priv->diff_offset, self->priv->diff_pending->len - self->priv->diff_offset);
+	self->priv->diff_offset = self->priv->diff_pending->len;
+	
+	/* every file with a placeholder line for its changes */
+	gint first = gtk_text_buffer_get_line_count(buf) - 1;
+	
+	for (i = 0; i < files->len; ++i)
+	{
+		format_file((DiffFile *)g_ptr_array_index(files, i), text);
+		g_string_append_printf(text, "%s\n", _("    (scroll here or click to load the changes)"));
+	}
+	
+	gtk_text_buffer_get_end_iter(buf, &iter);
+	gtk_text_buffer_insert(buf, &iter, text->str, text->len);
+	g_string_free(text, TRUE);
+	
+	for (i = 0; i < files->len; ++i)
+	{
+		DiffFile *file = (DiffFile *)g_ptr_array_index(files, i);
+		
+		gtk_text_buffer_get_iter_at_line(buf, &iter, first + i * 2 + 1);
+		file->mark = gtk_text_buffer_create_mark(buf, NULL, &iter, TRUE);
+	}
+	
+	on_diff_scrolled(NULL, self);
+}
+
+static gboolean
+diff_over_limits(GitgRevisionView *self)
+{
+	return (self->priv->max_diff_size && self->priv->diff_pending->len > self->priv->max_diff_size) ||
+	       (self->priv->max_diff_lines && self->priv->diff_read_lines > self->priv->max_diff_lines);
+}
+
+static void
+on_diff_update(GitgRunner *runner, gchar **buffer, GitgRevisionView *self)
+{
+	gchar *line;
+	
+	DiffSummary *summary = &self->priv->diff_summary;
 	
 	while ((line = *buffer++))
 	{
-		gtk_text_buffer_insert(buf, &iter, line, -1);
-		gtk_text_buffer_insert(buf, &iter, "\n", -1);
+		++self->priv->diff_read_lines;
+		
+		if (!summary_add_line(summary, line, self->priv->diff_pending))
+			continue;
+		
+		if (summary_is_large(summary))
+		{
+			show_files(self);
+			return;
+		}
+		
+		summary_format(summary, self->priv->diff_pending);
+		summary_add_line(summary, line, self->priv->diff_pending);
+	}
+	
+	/* skip the text that was shown before git show was stopped */
+	if (self->priv->diff_discard)
+	{
+		gsize size = MIN(self->priv->diff_discard, self->priv->diff_pending->len - self->priv->diff_offset);
+		
+		g_string_erase(self->priv->diff_pending, self->priv->diff_offset, size);
+		self->priv->diff_discard -= size;
 	}
+	
+	/* the text past the limits is only read when asked for */
+	if (!self->priv->diff_unlimited && diff_over_limits(self))
+	{
+		self->priv->diff_stopped = TRUE;
+		gitg_runner_cancel(runner);
+	}
+	
+	if (self->priv->diff_capped)
+		update_load_remaining(self);
+	else
+		schedule_insert(self);
+}
+
+static void
+on_load_remaining_clicked(GtkButton *button, GitgRevisionView *self)
+{
+	gtk_widget_hide(self->priv->load_remaining);
+	
+	self->priv->diff_capped = FALSE;
+	self->priv->diff_unlimited = TRUE;
+	
+	if (self->priv->diff_stopped && self->priv->repository)
+	{
+		/* read everything again, without what was shown already */
+		self->priv->diff_stopped = FALSE;
+		self->priv->diff_discard = self->priv->diff_offset;
+		
+		g_string_truncate(self->priv->diff_pending, 0);
+		self->priv->diff_offset = 0;
+		summary_reset(&self->priv->diff_summary, NULL);
+		
+		run_show(self, self->priv->diff_runner, self->priv->repository, self->priv->diff_hash, NULL, NULL);
+		return;
+	}
+	
+	schedule_insert(self);
 }
 
 static void
@@ -224,10 +1215,30 @@ gitg_revision_view_init(GitgRevisionView *self)
 	self->priv = GITG_REVISION_VIEW_GET_PRIVATE(self);
 	
 	self->priv->diff_runner = gitg_runner_new(2000);
+	self->priv->diff_pending = g_string_new("");
 	
 	g_signal_connect(self->priv->diff_runner, "begin-loading", G_CALLBACK(on_diff_begin_loading), self);
 	g_signal_connect(self->priv->diff_runner, "update", G_CALLBACK(on_diff_update), self);
 	g_signal_connect(self->priv->diff_runner, "end-loading", G_CALLBACK(on_diff_end_loading), self);
+	
+	self->priv->diff_cache = g_queue_new();
+	self->priv->diff_cache_index = g_hash_table_new(gitg_utils_hash_hash, gitg_utils_hash_equal);
+	
+	self->priv->prefetch_runner = gitg_runner_new(2000);
+	self->priv->prefetch_text = g_string_new("");
+	
+	g_signal_connect(self->priv->prefetch_runner, "update", G_CALLBACK(on_prefetch_update), self);
+	g_signal_connect(self->priv->prefetch_runner, "end-loading", G_CALLBACK(on_prefetch_end_loading), self);
+	
+	self->priv->diff_summary.files = g_ptr_array_new();
+	self->priv->prefetch_summary.files = g_ptr_array_new();
+	
+	self->priv->file_runner = gitg_runner_new(2000);
+	self->priv->file_text = g_string_new("");
+	self->priv->file_queue = g_queue_new();
+	
+	g_signal_connect(self->priv->file_runner, "update", G_CALLBACK(on_file_update), self);
+	g_signal_connect(self->priv->file_runner, "end-loading", G_CALLBACK(on_file_end_loading), self);
 }
 
 #define HASH_KEY "GitgRevisionViewHashKey"
@@ -328,34 +1339,67 @@ update_parents(GitgRevisionView *self, GitgRevision *revision)
 static void
 update_diff(GitgRevisionView *self, GitgRepository *repository, GitgRevision *revision)
 {	
-	// First cancel a possibly still running diff
+	// First cancel a possibly still running diff and prefetch
 	gitg_runner_cancel(self->priv->diff_runner);
 	
-	// Clear the buffer
+	self->priv->prefetch_num = 0;
+	gitg_runner_cancel(self->priv->prefetch_runner);
+	
+	if (self->priv->diff_idle_id)
+	{
+		g_source_remove(self->priv->diff_idle_id);
+		self->priv->diff_idle_id = 0;
+	}
+	
+	g_string_truncate(self->priv->diff_pending, 0);
+	self->priv->diff_offset = 0;
+	self->priv->diff_size = 0;
+	self->priv->diff_lines = 0;
+	self->priv->diff_capped = FALSE;
+	self->priv->diff_unlimited = FALSE;
+	self->priv->diff_read_lines = 0;
+	self->priv->diff_stopped = FALSE;
+	self->priv->diff_discard = 0;
+	
+	if (self->priv->load_remaining)
+		gtk_widget_hide(self->priv->load_remaining);
+	
+	// Forget the files of the previous diff
 	GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(self->priv->diff));
+	
+	self->priv->file_loading = NULL;
+	gitg_runner_cancel(self->priv->file_runner);
+	g_queue_clear(self->priv->file_queue);
+	
+	if (self->priv->visible_idle_id)
+	{
+		g_source_remove(self->priv->visible_idle_id);
+		self->priv->visible_idle_id = 0;
+	}
+	
+	summary_reset(&self->priv->diff_summary, buffer);
+	self->priv->diff_lazy = FALSE;
+	
+	// Clear the buffer
 	gtk_text_buffer_set_text(buffer, "", 0);
 	
 	if (!revision)
 		return;
-
-	gchar *hash = gitg_revision_get_sha1(revision);
-	gchar *gitpath = gitg_utils_dot_git_path(gitg_repository_get_path(repository));
 	
-	gchar const *argv[] = {
-		"git",
-		"--git-dir",
-		gitpath,
-		"show",
-		"--pretty=format:%s%n%n%b",
-		"--encoding=UTF-8",
-		hash,
-		NULL
-	};
+	memcpy(self->priv->diff_hash, gitg_revision_get_hash(revision), sizeof(Hash));
+	queue_prefetch(self, repository, revision);
 	
-	gitg_runner_run(self->priv->diff_runner, argv, NULL);
-
-	g_free(hash);
-	g_free(gitpath);
+	DiffCacheEntry *entry = cache_lookup(self, self->priv->diff_hash);
+	
+	if (entry)
+	{
+		g_string_append_len(self->priv->diff_pending, entry->text, entry->size);
+		schedule_insert(self);
+		schedule_prefetch(self);
+		return;
+	}
+	
+	run_show(self, self->priv->diff_runner, repository, self->priv->diff_hash, NULL, NULL);
 }
 
 static gchar *
@@ -425,5 +1469,29 @@ gitg_revision_view_set_repository(GitgRevisionView *view, GitgRepository *reposi
 	if (repository)
 		view->priv->repository = g_object_ref(repository);
 	
+	cache_clear(view);
 	g_object_notify(G_OBJECT(view), "repository");
 }
+
+void
+gitg_revision_view_set_side_by_side(GitgRevisionView *self, gboolean side_by_side)
+{
+	g_return_if_fail(GITG_IS_REVISION_VIEW(self));
+	
+	if (self->priv->side_by_side == side_by_side || !self->priv->diff_side)
+		return;
+	
+	self->priv->side_by_side = side_by_side;
+	GtkWidget *scrolled = gtk_widget_get_parent(GTK_WIDGET(self->priv->diff));
+	
+	if (side_by_side)
+	{
+		gtk_widget_hide(scrolled);
+		gtk_widget_show(self->priv->diff_side);
+	}
+	else
+	{
+		gtk_widget_hide(self->priv->diff_side);
+		gtk_widget_show(scrolled);
+	}
+}
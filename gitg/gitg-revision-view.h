@@ -35,6 +35,9 @@ GType gitg_revision_view_get_type (void) G_GNUC_CONST;
 
 void gitg_revision_view_update(GitgRevisionView *revision_view, GitgRepository *repository, GitgRevision *revision);
 
+/* Shows the diff with the old and new lines next to each other */
+void gitg_revision_view_set_side_by_side(GitgRevisionView *revision_view, gboolean side_by_side);
+
 
 G_END_DECLS
 
@@ -12,7 +12,8 @@ struct _GitgRevision
 	guint num_parents;
 	char sign;
 	
-	GSList *lanes;
+	GitgLaneArena *arena;
+	guint8 const *lanes;
 	gint8 mylane;
 
 	gint64 timestamp;
@@ -21,8 +22,9 @@ struct _GitgRevision
 static void
 free_lanes(GitgRevision *rv)
 {
-	g_slist_foreach(rv->lanes, (GFunc)gitg_lane_free, NULL);
-	g_slist_free(rv->lanes);
+	gitg_lane_arena_unref(rv->arena);
+
+	rv->arena = NULL;
 	rv->lanes = NULL;
 }
 
@@ -150,55 +152,29 @@ gitg_revision_get_parents(GitgRevision *revision)
 	return ret;
 }
 
-GSList *
+guint8 const *
 gitg_revision_get_lanes(GitgRevision *revision)
 {
 	return revision->lanes;
 }
 
-GSList *
-gitg_revision_remove_lane(GitgRevision *revision, GitgLane *lane)
-{
-	revision->lanes = g_slist_remove(revision->lanes, lane);
-	gitg_lane_free(lane);
-	
-	return revision->lanes;
-}
-
-GSList *
-gitg_revision_insert_lane(GitgRevision *revision, GitgLane *lane, gint index)
-{
-	revision->lanes = g_slist_insert(revision->lanes, lane, index);
-	
-	return revision->lanes;
-}
-
-static void
-update_lane_type(GitgRevision *revision)
+GitgLaneArena *
+gitg_revision_get_lane_arena(GitgRevision *revision)
 {
-	GitgLane *lane = (GitgLane *)g_slist_nth_data(revision->lanes, revision->mylane);
-	
-	if (lane == NULL)
-		return;
-	
-	lane->type &= ~(GITG_LANE_SIGN_LEFT | GITG_LANE_SIGN_RIGHT);
-	
-	if (revision->sign == '<')
-		lane->type |= GITG_LANE_SIGN_LEFT;
-	else if (revision->sign == '>')
-		lane->type |= GITG_LANE_SIGN_RIGHT;
+	return revision->arena;
 }
 
 void 
-gitg_revision_set_lanes(GitgRevision *revision, GSList *lanes, gint8 mylane)
+gitg_revision_set_lanes(GitgRevision *revision, GitgLaneArena *arena, guint8 const *lanes, gint8 mylane)
 {
+	gitg_lane_arena_ref(arena);
 	free_lanes(revision);
+
+	revision->arena = arena;
 	revision->lanes = lanes;
 	
 	if (mylane >= 0)
 		revision->mylane = mylane;
-
-	update_lane_type(revision);
 }
 
 gint8
@@ -213,7 +189,6 @@ gitg_revision_set_mylane(GitgRevision *revision, gint8 mylane)
 	g_return_if_fail(mylane >= 0);
 
 	revision->mylane = mylane;
-	update_lane_type(revision);
 }
 
 void
@@ -242,8 +217,17 @@ gitg_revision_get_type (void)
 	return our_type;
 } 
 
-GitgLane *
-gitg_revision_get_lane(GitgRevision *revision)
+gboolean
+gitg_revision_get_lane(GitgRevision *revision, GitgLane *lane)
 {
-	return (GitgLane *)g_slist_nth_data(revision->lanes, revision->mylane);
+	if (!gitg_lane_row_nth(revision->lanes, revision->mylane, lane))
+		return FALSE;
+	
+	/* the sign is not part of the packed row */
+	if (revision->sign == '<')
+		lane->type |= GITG_LANE_SIGN_LEFT;
+	else if (revision->sign == '>')
+		lane->type |= GITG_LANE_SIGN_RIGHT;
+	
+	return TRUE;
 }
@@ -28,12 +28,10 @@ inline Hash *gitg_revision_get_parents_hash(GitgRevision *revision, guint *num_p
 gchar *gitg_revision_get_sha1(GitgRevision *revision);
 gchar **gitg_revision_get_parents(GitgRevision *revision);
 
-GSList *gitg_revision_get_lanes(GitgRevision *revision);
-GitgLane *gitg_revision_get_lane(GitgRevision *revision);
-void gitg_revision_set_lanes(GitgRevision *revision, GSList *lanes, gint8 mylane);
-
-GSList *gitg_revision_remove_lane(GitgRevision *revision, GitgLane *lane);
-GSList *gitg_revision_insert_lane(GitgRevision *revision, GitgLane *lane, gint index);
+guint8 const *gitg_revision_get_lanes(GitgRevision *revision);
+GitgLaneArena *gitg_revision_get_lane_arena(GitgRevision *revision);
+gboolean gitg_revision_get_lane(GitgRevision *revision, GitgLane *lane);
+void gitg_revision_set_lanes(GitgRevision *revision, GitgLaneArena *arena, guint8 const *lanes, gint8 mylane);
 
 gint8 gitg_revision_get_mylane(GitgRevision *revision);
 void gitg_revision_set_mylane(GitgRevision *revision, gint8 mylane);
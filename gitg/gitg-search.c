@@ -0,0 +1,517 @@
+#include "gitg-search.h"
+#include "gitg-utils.h"
+#include <string.h>
+
+/* Search keeps a case folded copy of the searchable text of every loaded
+   revision, built lazily the first time a row is searched. Revisions are fed
+   in log order from the main thread, queries are matched on a worker thread
+   in chunks of rows, so a new query (every keystroke) can replace a running
+   one quickly. Matching rows are collected in ascending order and can be
+   inspected from the main thread at any time */
+
+#define SCAN_CHUNK 4096
+
+typedef enum
+{
+	ITEM_BATCH,
+	ITEM_QUERY,
+	ITEM_DATES,
+	ITEM_STOP
+} ItemType;
+
+typedef struct
+{
+	ItemType type;
+
+	/* ITEM_BATCH */
+	GitgRevision **revisions;
+	guint num;
+
+	/* ITEM_QUERY, a NULL key cancels the current query */
+	gchar *key;
+	GitgSearchField field;
+	gboolean ignore_accents;
+	guint generation;
+
+	/* ITEM_DATES */
+	gboolean relative_dates;
+} Item;
+
+struct _GitgSearch
+{
+	GThread *thread;
+	GAsyncQueue *queue;
+	GMutex *mutex;
+	volatile gint cancelled;
+
+	GitgSearchFunc func;
+	gpointer userdata;
+	guint idle_id;
+
+	/* only used by the worker */
+	GPtrArray *revisions;
+	GStringChunk *chunk;
+	gchar const **corpus[GITG_SEARCH_NUM_FIELDS];
+	guint allocated;
+	gboolean strip_accents;
+	gboolean relative_dates;
+
+	Item *query;
+	guint scanned;
+	GArray *found;
+
+	/* protected by mutex */
+	guint generation;
+	GArray *matches;
+	gboolean finished;
+};
+
+static Item stop_item = {ITEM_STOP};
+
+static gchar *
+fold_text(gchar const *text, gboolean strip_accents)
+{
+	gchar *decomposed = strip_accents ? g_utf8_normalize(text, -1, G_NORMALIZE_NFD) : NULL;
+
+	if (!decomposed)
+		return g_utf8_casefold(text, -1);
+
+	/* drop the combining marks of the decomposed characters */
+	GString *stripped = g_string_sized_new(strlen(decomposed));
+	gchar const *ptr;
+
+	for (ptr = decomposed; *ptr; ptr = g_utf8_next_char(ptr))
+	{
+		gunichar c = g_utf8_get_char(ptr);
+
+		if (g_unichar_type(c) != G_UNICODE_NON_SPACING_MARK)
+			g_string_append_unichar(stripped, c);
+	}
+
+	gchar *ret = g_utf8_casefold(stripped->str, stripped->len);
+
+	g_string_free(stripped, TRUE);
+	g_free(decomposed);
+
+	return ret;
+}
+
+static gchar *
+field_text(GitgSearch *search, GitgRevision *revision, GitgSearchField field)
+{
+	switch (field)
+	{
+		case GITG_SEARCH_SUBJECT:
+			return g_strdup(gitg_revision_get_subject(revision));
+		case GITG_SEARCH_AUTHOR:
+			return g_strdup(gitg_revision_get_author(revision));
+		case GITG_SEARCH_DATE:
+			/* match the dates as the history view shows them */
+			return gitg_utils_timestamp_to_str(gitg_revision_get_timestamp(revision), search->relative_dates);
+		case GITG_SEARCH_HASH:
+			return gitg_revision_get_sha1(revision);
+		default:
+			return g_strdup("");
+	}
+}
+
+static gchar const *
+corpus_text(GitgSearch *search, guint row, GitgSearchField field)
+{
+	gchar const **corpus = search->corpus[field];
+
+	if (!corpus)
+	{
+		corpus = g_new0(gchar const *, search->allocated);
+		search->corpus[field] = corpus;
+	}
+
+	if (!corpus[row])
+	{
+		gchar *text = field_text(search, GITG_REVISION(g_ptr_array_index(search->revisions, row)), field);
+		gchar *folded = fold_text(text, search->strip_accents);
+
+		/* authors and relative dates repeat a lot, share their text */
+		if (field == GITG_SEARCH_AUTHOR || (field == GITG_SEARCH_DATE && search->relative_dates))
+			corpus[row] = g_string_chunk_insert_const(search->chunk, folded);
+		else
+			corpus[row] = g_string_chunk_insert(search->chunk, folded);
+
+		g_free(folded);
+		g_free(text);
+	}
+
+	return corpus[row];
+}
+
+static void
+clear_corpus(GitgSearch *search)
+{
+	guint i;
+
+	for (i = 0; i < GITG_SEARCH_NUM_FIELDS; ++i)
+	{
+		g_free(search->corpus[i]);
+		search->corpus[i] = NULL;
+	}
+
+	if (search->chunk)
+		g_string_chunk_free(search->chunk);
+
+	search->chunk = g_string_chunk_new(64 * 1024);
+}
+
+static void
+free_item(Item *item)
+{
+	g_free(item->revisions);
+	g_free(item->key);
+	g_slice_free(Item, item);
+}
+
+static gboolean
+on_idle_notify(GitgSearch *search)
+{
+	g_mutex_lock(search->mutex);
+
+	gboolean finished = search->finished;
+	search->idle_id = 0;
+
+	g_mutex_unlock(search->mutex);
+
+	search->func(search, finished, search->userdata);
+	return FALSE;
+}
+
+static void
+process_batch(GitgSearch *search, Item *item)
+{
+	guint size = search->revisions->len + item->num;
+	guint i;
+
+	if (size > search->allocated)
+	{
+		guint prev = search->allocated;
+		search->allocated = MAX(MAX(prev * 2, 1024), size);
+
+		for (i = 0; i < GITG_SEARCH_NUM_FIELDS; ++i)
+		{
+			if (!search->corpus[i])
+				continue;
+
+			search->corpus[i] = g_renew(gchar const *, search->corpus[i], search->allocated);
+			memset(search->corpus[i] + prev, 0, (search->allocated - prev) * sizeof(gchar const *));
+		}
+	}
+
+	for (i = 0; i < item->num; ++i)
+		g_ptr_array_add(search->revisions, item->revisions[i]);
+
+	free_item(item);
+}
+
+static void
+process_query(GitgSearch *search, Item *item)
+{
+	if (search->query)
+		free_item(search->query);
+
+	search->query = NULL;
+	search->scanned = 0;
+
+	if (!item->key)
+	{
+		free_item(item);
+		return;
+	}
+
+	if (item->ignore_accents != search->strip_accents)
+	{
+		search->strip_accents = item->ignore_accents;
+		clear_corpus(search);
+	}
+
+	gchar *folded = fold_text(item->key, search->strip_accents);
+	g_free(item->key);
+
+	item->key = folded;
+	search->query = item;
+}
+
+static void
+process_dates(GitgSearch *search, Item *item)
+{
+	if (item->relative_dates != search->relative_dates)
+	{
+		/* the texts stay in the chunk until the corpus is cleared */
+		search->relative_dates = item->relative_dates;
+
+		g_free(search->corpus[GITG_SEARCH_DATE]);
+		search->corpus[GITG_SEARCH_DATE] = NULL;
+	}
+
+	free_item(item);
+}
+
+static void
+scan_chunk(GitgSearch *search)
+{
+	Item *query = search->query;
+	guint end = MIN(search->scanned + SCAN_CHUNK, search->revisions->len);
+	gsize len = strlen(query->key);
+	guint row;
+
+	g_array_set_size(search->found, 0);
+
+	for (row = search->scanned; row < end; ++row)
+	{
+		gchar const *text = corpus_text(search, row, query->field);
+		gboolean match;
+
+		if (query->field == GITG_SEARCH_HASH)
+			match = strncmp(text, query->key, len) == 0;
+		else
+			match = strstr(text, query->key) != NULL;
+
+		if (match)
+			g_array_append_val(search->found, row);
+	}
+
+	search->scanned = end;
+
+	g_mutex_lock(search->mutex);
+
+	/* the main thread may have started another query already */
+	if (query->generation == search->generation)
+	{
+		g_array_append_vals(search->matches, search->found->data, search->found->len);
+		search->finished = end == search->revisions->len;
+
+		if (search->func && !search->idle_id && (search->found->len || search->finished))
+			search->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)on_idle_notify, search, NULL);
+	}
+
+	g_mutex_unlock(search->mutex);
+}
+
+static gpointer
+worker(GitgSearch *search)
+{
+	while (TRUE)
+	{
+		Item *item;
+
+		if (search->query && search->scanned < search->revisions->len && !g_atomic_int_get(&search->cancelled))
+			item = (Item *)g_async_queue_try_pop(search->queue);
+		else
+			item = (Item *)g_async_queue_pop(search->queue);
+
+		if (item == &stop_item)
+			break;
+
+		if (!item)
+			scan_chunk(search);
+		else if (item->type == ITEM_BATCH)
+			process_batch(search, item);
+		else if (item->type == ITEM_DATES)
+			process_dates(search, item);
+		else
+			process_query(search, item);
+	}
+
+	return NULL;
+}
+
+GitgSearch *
+gitg_search_new(GitgSearchFunc func, gpointer userdata)
+{
+	GitgSearch *search = g_slice_new0(GitgSearch);
+
+	search->func = func;
+	search->userdata = userdata;
+
+	search->revisions = g_ptr_array_new();
+	search->found = g_array_new(FALSE, FALSE, sizeof(guint));
+	search->matches = g_array_new(FALSE, FALSE, sizeof(guint));
+	search->finished = TRUE;
+
+	clear_corpus(search);
+
+	search->mutex = g_mutex_new();
+	search->queue = g_async_queue_new();
+	search->thread = g_thread_create((GThreadFunc)worker, search, TRUE, NULL);
+
+	return search;
+}
+
+void
+gitg_search_free(GitgSearch *search)
+{
+	guint i;
+
+	if (!search)
+		return;
+
+	g_atomic_int_set(&search->cancelled, 1);
+	g_async_queue_push(search->queue, &stop_item);
+	g_thread_join(search->thread);
+
+	if (search->idle_id)
+		g_source_remove(search->idle_id);
+
+	g_async_queue_unref(search->queue);
+	g_mutex_free(search->mutex);
+
+	if (search->query)
+		free_item(search->query);
+
+	for (i = 0; i < search->revisions->len; ++i)
+		gitg_revision_unref(GITG_REVISION(g_ptr_array_index(search->revisions, i)));
+
+	g_ptr_array_free(search->revisions, TRUE);
+
+	for (i = 0; i < GITG_SEARCH_NUM_FIELDS; ++i)
+		g_free(search->corpus[i]);
+
+	g_string_chunk_free(search->chunk);
+	g_array_free(search->found, TRUE);
+	g_array_free(search->matches, TRUE);
+
+	g_slice_free(GitgSearch, search);
+}
+
+void
+gitg_search_push(GitgSearch *search, GitgRevision **revisions, guint num)
+{
+	guint i;
+
+	if (num == 0)
+		return;
+
+	Item *item = g_slice_new0(Item);
+	item->type = ITEM_BATCH;
+	item->revisions = g_new(GitgRevision *, num);
+	item->num = num;
+
+	for (i = 0; i < num; ++i)
+		item->revisions[i] = gitg_revision_ref(revisions[i]);
+
+	g_async_queue_push(search->queue, item);
+}
+
+void
+gitg_search_set_relative_dates(GitgSearch *search, gboolean relative_dates)
+{
+	Item *item = g_slice_new0(Item);
+	item->type = ITEM_DATES;
+	item->relative_dates = relative_dates;
+
+	g_async_queue_push(search->queue, item);
+}
+
+static void
+push_query(GitgSearch *search, GitgSearchField field, gchar const *key, gboolean ignore_accents)
+{
+	Item *item = g_slice_new0(Item);
+	item->type = ITEM_QUERY;
+	item->key = g_strdup(key);
+	item->field = field;
+	item->ignore_accents = ignore_accents;
+
+	g_mutex_lock(search->mutex);
+
+	item->generation = ++search->generation;
+	g_array_set_size(search->matches, 0);
+	search->finished = key == NULL;
+
+	g_mutex_unlock(search->mutex);
+
+	g_async_queue_push(search->queue, item);
+}
+
+void
+gitg_search_start(GitgSearch *search, GitgSearchField field, gchar const *key, gboolean ignore_accents)
+{
+	g_return_if_fail(field < GITG_SEARCH_NUM_FIELDS);
+
+	if (key && !*key)
+		key = NULL;
+
+	push_query(search, field, key, ignore_accents);
+}
+
+void
+gitg_search_cancel(GitgSearch *search)
+{
+	push_query(search, GITG_SEARCH_SUBJECT, NULL, FALSE);
+}
+
+guint
+gitg_search_get_num_matches(GitgSearch *search)
+{
+	g_mutex_lock(search->mutex);
+	guint ret = search->matches->len;
+	g_mutex_unlock(search->mutex);
+
+	return ret;
+}
+
+/* index of the first match >= row, call with the mutex held */
+static guint
+lower_bound(GArray *matches, guint row)
+{
+	guint lo = 0;
+	guint hi = matches->len;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+
+		if (g_array_index(matches, guint, mid) < row)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+gboolean
+gitg_search_is_match(GitgSearch *search, guint row)
+{
+	g_mutex_lock(search->mutex);
+
+	guint index = lower_bound(search->matches, row);
+	gboolean ret = index < search->matches->len && g_array_index(search->matches, guint, index) == row;
+
+	g_mutex_unlock(search->mutex);
+	return ret;
+}
+
+/* the nearest match after (or before) row, -1 if there is none (yet) */
+gint
+gitg_search_find(GitgSearch *search, gint row, gboolean forward)
+{
+	gint ret = -1;
+	guint index;
+
+	g_mutex_lock(search->mutex);
+
+	if (forward)
+	{
+		index = lower_bound(search->matches, row < 0 ? 0 : (guint)row + 1);
+
+		if (index < search->matches->len)
+			ret = g_array_index(search->matches, guint, index);
+	}
+	else if (row > 0)
+	{
+		index = lower_bound(search->matches, (guint)row);
+
+		if (index > 0)
+			ret = g_array_index(search->matches, guint, index - 1);
+	}
+
+	g_mutex_unlock(search->mutex);
+	return ret;
+}
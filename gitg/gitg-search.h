@@ -0,0 +1,34 @@
+#ifndef __GITG_SEARCH_H__
+#define __GITG_SEARCH_H__
+
+#include <glib.h>
+#include "gitg-revision.h"
+
+typedef enum
+{
+	GITG_SEARCH_SUBJECT,
+	GITG_SEARCH_AUTHOR,
+	GITG_SEARCH_DATE,
+	GITG_SEARCH_HASH,
+	GITG_SEARCH_NUM_FIELDS
+} GitgSearchField;
+
+typedef struct _GitgSearch GitgSearch;
+
+/* Called from the main loop when new matches were found */
+typedef void (*GitgSearchFunc)(GitgSearch *search, gboolean finished, gpointer userdata);
+
+GitgSearch *gitg_search_new(GitgSearchFunc func, gpointer userdata);
+void gitg_search_free(GitgSearch *search);
+
+void gitg_search_push(GitgSearch *search, GitgRevision **revisions, guint num);
+void gitg_search_set_relative_dates(GitgSearch *search, gboolean relative_dates);
+
+void gitg_search_start(GitgSearch *search, GitgSearchField field, gchar const *key, gboolean ignore_accents);
+void gitg_search_cancel(GitgSearch *search);
+
+guint gitg_search_get_num_matches(GitgSearch *search);
+gboolean gitg_search_is_match(GitgSearch *search, guint row);
+gint gitg_search_find(GitgSearch *search, gint row, gboolean forward);
+
+#endif /* __GITG_SEARCH_H__ */
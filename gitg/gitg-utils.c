@@ -1,6 +1,8 @@
 #include <string.h>
 #include <glib.h>
 #include <gconf/gconf-client.h>
+#include <glib/gi18n.h>
+#include <time.h>
 
 #include "gitg-utils.h"
 
@@ -419,6 +421,72 @@ gitg_utils_menu_position_under_tree_view (GtkMenu  *menu,
 	}
 }
 
+static gchar *
+timestamp_to_str(guint64 timestamp)
+{
+	time_t t = timestamp;
+	struct tm tms;
+	char buf[255];
+	
+	/* also used from the search thread */
+	localtime_r(&t, &tms);
+	strftime(buf, 255, "%c", &tms);
+	
+	return g_strdup(buf);
+}
+
+static gchar *
+timestamp_to_relative_str(guint64 timestamp)
+{
+	gint64 diff = (gint64)time(NULL) - (gint64)timestamp;
+	gulong num;
+	
+	if (diff < 0)
+		return timestamp_to_str(timestamp);
+	
+	if (diff < 60)
+		return g_strdup(_("Just now"));
+	
+	if (diff < 60 * 60)
+	{
+		num = diff / 60;
+		return g_strdup_printf(ngettext("%lu minute ago", "%lu minutes ago", num), num);
+	}
+	
+	if (diff < 60 * 60 * 24)
+	{
+		num = diff / (60 * 60);
+		return g_strdup_printf(ngettext("%lu hour ago", "%lu hours ago", num), num);
+	}
+	
+	if (diff < 60 * 60 * 24 * 14)
+	{
+		num = diff / (60 * 60 * 24);
+		return g_strdup_printf(ngettext("%lu day ago", "%lu days ago", num), num);
+	}
+	
+	if (diff < 60 * 60 * 24 * 60)
+	{
+		num = diff / (60 * 60 * 24 * 7);
+		return g_strdup_printf(ngettext("%lu week ago", "%lu weeks ago", num), num);
+	}
+	
+	if (diff < 60 * 60 * 24 * 365)
+	{
+		num = diff / (60 * 60 * 24 * 30);
+		return g_strdup_printf(ngettext("%lu month ago", "%lu months ago", num), num);
+	}
+	
+	num = diff / (60 * 60 * 24 * 365);
+	return g_strdup_printf(ngettext("%lu year ago", "%lu years ago", num), num);
+}
+
+gchar *
+gitg_utils_timestamp_to_str(guint64 timestamp, gboolean relative)
+{
+	return relative ? timestamp_to_relative_str(timestamp) : timestamp_to_str(timestamp);
+}
+
 gchar *
 gitg_utils_get_monospace_font_name()
 {
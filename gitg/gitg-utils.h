@@ -21,6 +21,7 @@ gboolean gitg_utils_export_files(GitgRepository *repository, GitgRevision *revis
 gchar const *todir, gchar * const *paths);
 
 gchar *gitg_utils_convert_utf8(gchar const *str, gssize size);
+gchar *gitg_utils_timestamp_to_str(guint64 timestamp, gboolean relative);
 
 guint gitg_utils_hash_hash(gconstpointer v);
 gboolean gitg_utils_hash_equal(gconstpointer a, gconstpointer b);
@@ -31,6 +31,15 @@ struct _GitgWindowPrivate
 	GitgRevisionTreeView *revision_tree_view;
 	GitgCommitView *commit_view;
 	GtkWidget *search_popup;
+	GtkEntry *search_entry;
+	GitgSearchField search_field;
+	gboolean search_ignore_accents;
+	gboolean search_jump;
+	
+	/* content search, only started on activating the entry */
+	gboolean search_content;
+	gboolean search_regex;
+	gboolean search_stale;
 	GtkComboBox *combo_branches;
 	
 	GtkActionGroup *edit_group;
@@ -85,75 +94,211 @@ on_search_icon_pressed(SexyIconEntry *entry, SexyIconEntryPosition icon_pos, int
 	gtk_menu_popup(GTK_MENU(window->priv->search_popup), NULL, NULL, NULL, NULL, button, gtk_get_current_event_time());
 }
 
+static gint
+selected_row(GitgWindow *window)
+{
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	
+	if (!gtk_tree_selection_get_selected(gtk_tree_view_get_selection(window->priv->tree_view), &model, &iter))
+		return -1;
+	
+	return gitg_repository_get_row(window->priv->repository, &iter);
+}
+
+static void
+goto_row(GitgWindow *window, gint row)
+{
+	GtkTreePath *path = gtk_tree_path_new_from_indices(row, -1);
+	
+	gtk_tree_selection_select_path(gtk_tree_view_get_selection(window->priv->tree_view), path);
+	gtk_tree_view_scroll_to_cell(window->priv->tree_view, path, NULL, FALSE, 0, 0);
+	gtk_tree_path_free(path);
+}
+
+static void
+update_search(GitgWindow *window)
+{
+	if (!window->priv->repository)
+		return;
+	
+	/* jump to the first match once it has been found */
+	window->priv->search_jump = TRUE;
+	window->priv->search_stale = FALSE;
+	
+	if (window->priv->search_content)
+	{
+		gitg_repository_search_changes(window->priv->repository,
+		                               gtk_entry_get_text(window->priv->search_entry),
+		                               window->priv->search_regex);
+	}
+	else
+	{
+		gitg_repository_search(window->priv->repository, 
+		                       window->priv->search_field, 
+		                       gtk_entry_get_text(window->priv->search_entry),
+		                       window->priv->search_ignore_accents);
+	}
+
+	gtk_widget_queue_draw(GTK_WIDGET(window->priv->tree_view));
+}
+
+static void
+search_move(GitgWindow *window, gboolean forward)
+{
+	if (!window->priv->repository)
+		return;
+	
+	gint row = gitg_repository_search_find(window->priv->repository, selected_row(window), forward);
+	
+	/* wrap around */
+	if (row == -1)
+		row = gitg_repository_search_find(window->priv->repository, forward ? -1 : G_MAXINT, forward);
+	
+	if (row != -1)
+		goto_row(window, row);
+	
+	window->priv->search_jump = FALSE;
+}
+
+static void
+on_search_updated(GitgRepository *repository, gboolean finished, GitgWindow *window)
+{
+	if (window->priv->search_jump)
+	{
+		/* first match at or after the selection, or any when none follows */
+		gint row = gitg_repository_search_find(repository, selected_row(window) - 1, TRUE);
+		
+		if (row == -1 && finished)
+			row = gitg_repository_search_find(repository, -1, TRUE);
+		
+		if (row != -1)
+		{
+			window->priv->search_jump = FALSE;
+			goto_row(window, row);
+		}
+	}
+	
+	if (window->priv->search_content && !window->priv->search_stale)
+	{
+		guint num = gitg_repository_search_get_num_matches(repository);
+		gchar *msg;
+		
+		if (finished)
+			msg = g_strdup_printf(_("Found %d revisions changing the content"), num);
+		else
+			msg = g_strdup_printf(_("Searching content, %d revisions found..."), num);
+		
+		gtk_statusbar_push(window->priv->statusbar, 0, msg);
+		g_free(msg);
+	}
+	
+	/* redraw the highlighted matches */
+	gtk_widget_queue_draw(GTK_WIDGET(window->priv->tree_view));
+}
+
+static void
+on_search_changed(GtkEntry *entry, GitgWindow *window)
+{
+	if (!window->priv->search_content)
+	{
+		update_search(window);
+		return;
+	}
+	
+	/* running git for every keystroke is too expensive, cancel the running
+	   content search until the entry is activated */
+	window->priv->search_stale = TRUE;
+	
+	if (window->priv->repository)
+		gitg_repository_search_cancel(window->priv->repository);
+
+	gtk_widget_queue_draw(GTK_WIDGET(window->priv->tree_view));
+}
+
+static void
+on_search_activate(GtkEntry *entry, GitgWindow *window)
+{
+	if (window->priv->search_stale)
+		update_search(window);
+	else
+		search_move(window, TRUE);
+}
+
+static gboolean
+on_search_key_press(GtkWidget *entry, GdkEventKey *event, GitgWindow *window)
+{
+	if (event->keyval != GDK_Escape)
+		return FALSE;
+	
+	/* clearing the entry cancels the search */
+	gtk_entry_set_text(GTK_ENTRY(entry), "");
+	return TRUE;
+}
+
 void
-search_column_activate(GtkAction *action, gint column, GtkTreeView *tree_view)
+search_column_activate(GtkAction *action, GitgSearchField field, GitgWindow *window)
 {
 	if (!gtk_toggle_action_get_active(GTK_TOGGLE_ACTION(action)))
 		return;
 
-	gtk_tree_view_set_search_column(tree_view, column);
+	window->priv->search_field = field;
+	window->priv->search_content = FALSE;
+	update_search(window);
+}
+
+void
+search_content_activate(GtkAction *action, gboolean regex, GitgWindow *window)
+{
+	if (!gtk_toggle_action_get_active(GTK_TOGGLE_ACTION(action)))
+		return;
+	
+	window->priv->search_content = TRUE;
+	window->priv->search_regex = regex;
+	update_search(window);
 }
 
 void
 on_subject_activate(GtkAction *action, GitgWindow *window)
 {
-	search_column_activate(action, 1, window->priv->tree_view);
+	search_column_activate(action, GITG_SEARCH_SUBJECT, window);
 }
 
 void
 on_author_activate(GtkAction *action, GitgWindow *window)
 {
-	search_column_activate(action, 2, window->priv->tree_view);
+	search_column_activate(action, GITG_SEARCH_AUTHOR, window);
 }
 
 void
 on_date_activate(GtkAction *action, GitgWindow *window)
 {
-	search_column_activate(action, 3, window->priv->tree_view);
+	search_column_activate(action, GITG_SEARCH_DATE, window);
 }
 
 void
 on_hash_activate(GtkAction *action, GitgWindow *window)
 {
-	search_column_activate(action, 4, window->priv->tree_view);
+	search_column_activate(action, GITG_SEARCH_HASH, window);
 }
 
-static gboolean
-search_hash_equal_func(GtkTreeModel *model, gchar const *key, GtkTreeIter *iter)
+void
+on_content_activate(GtkAction *action, GitgWindow *window)
 {
-	GitgRevision *rv;
-	gtk_tree_model_get(model, iter, 0, &rv, -1);
-	
-	gchar *sha = gitg_revision_get_sha1(rv);
-	
-	gboolean ret = strncmp(sha, key, strlen(key)) != 0;
-	
-	g_free(sha);
-	gitg_revision_unref(rv);
-	
-	return ret;
+	search_content_activate(action, FALSE, window);
 }
 
-static gboolean
-search_equal_func(GtkTreeModel *model, gint column, gchar const *key, GtkTreeIter *iter, gpointer userdata)
+void
+on_content_regex_activate(GtkAction *action, GitgWindow *window)
 {
-	if (column == 4)
-		return search_hash_equal_func(model, key, iter);
-
-	gchar *cmp;
-	gtk_tree_model_get(model, iter, column, &cmp, -1);
-	
-	gchar *s1 = g_utf8_casefold(key, -1);
-	gchar *s2 = g_utf8_casefold(cmp, -1);
-	
-	gboolean ret = strstr(s2, s1) == NULL;
-	
-	g_free(s1);
-	g_free(s2);
+	search_content_activate(action, TRUE, window);
+}
 
-	g_free(cmp);
-	
-	return ret;
+void
+on_ignore_accents_toggled(GtkToggleAction *action, GitgWindow *window)
+{
+	window->priv->search_ignore_accents = gtk_toggle_action_get_active(action);
+	update_search(window);
 }
 
 static void
@@ -162,6 +307,18 @@ focus_search(GtkAccelGroup *group, GObject *acceleratable, guint keyval, GdkModi
 	gtk_widget_grab_focus(GTK_WIDGET(userdata));
 }
 
+static void
+find_next(GtkAccelGroup *group, GObject *acceleratable, guint keyval, GdkModifierType modifier, gpointer userdata)
+{
+	search_move(GITG_WINDOW(userdata), TRUE);
+}
+
+static void
+find_previous(GtkAccelGroup *group, GObject *acceleratable, guint keyval, GdkModifierType modifier, gpointer userdata)
+{
+	search_move(GITG_WINDOW(userdata), FALSE);
+}
+
 static void
 build_search_entry(GitgWindow *window, GtkBuilder *builder)
 {
@@ -171,7 +328,7 @@ build_search_entry(GitgWindow *window, GtkBuilder *builder)
 	GtkImage *image = GTK_IMAGE(gtk_image_new_from_stock(GTK_STOCK_FIND, GTK_ICON_SIZE_MENU));
 	sexy_icon_entry_set_icon(SEXY_ICON_ENTRY(entry), SEXY_ICON_ENTRY_PRIMARY, image);
 	
-	gtk_tree_view_set_search_entry(window->priv->tree_view, GTK_ENTRY(entry));
+	window->priv->search_entry = GTK_ENTRY(entry);
 	gtk_widget_show(entry);
 	gtk_box_pack_end(GTK_BOX(box), entry, FALSE, FALSE, 0);
 	
@@ -193,14 +350,27 @@ build_search_entry(GitgWindow *window, GtkBuilder *builder)
 	g_object_unref(b);
 	
 	g_signal_connect(entry, "icon-pressed", G_CALLBACK(on_search_icon_pressed), window);
-	gtk_tree_view_set_search_column(window->priv->tree_view, 1);
+	g_signal_connect(entry, "changed", G_CALLBACK(on_search_changed), window);
+	g_signal_connect(entry, "activate", G_CALLBACK(on_search_activate), window);
+	g_signal_connect(entry, "key-press-event", G_CALLBACK(on_search_key_press), window);
 	
-	gtk_tree_view_set_search_equal_func(window->priv->tree_view, search_equal_func, window, NULL);
+	/* searching is done by the repository, not the interactive search of
+	   the tree view */
+	window->priv->search_field = GITG_SEARCH_SUBJECT;
+	window->priv->search_ignore_accents = TRUE;
+	gtk_tree_view_set_enable_search(window->priv->tree_view, FALSE);
 	
 	GtkAccelGroup *group = gtk_accel_group_new();
 	
 	GClosure *closure = g_cclosure_new(G_CALLBACK(focus_search), entry, NULL); 
 	gtk_accel_group_connect(group, GDK_f, GDK_CONTROL_MASK, 0, closure); 
+	
+	closure = g_cclosure_new(G_CALLBACK(find_next), window, NULL);
+	gtk_accel_group_connect(group, GDK_g, GDK_CONTROL_MASK, 0, closure);
+	
+	closure = g_cclosure_new(G_CALLBACK(find_previous), window, NULL);
+	gtk_accel_group_connect(group, GDK_g, GDK_CONTROL_MASK | GDK_SHIFT_MASK, 0, closure);
+	
 	gtk_window_add_accel_group(GTK_WINDOW(window), group);
 }
 
@@ -230,22 +400,9 @@ on_parent_activated(GitgRevisionView *view, gchar *hash, GitgWindow *window)
 static void
 on_renderer_path(GtkTreeViewColumn *column, GitgCellRendererPath *renderer, GtkTreeModel *model, GtkTreeIter *iter, GitgWindow *window)
 {
-	GitgRevision *rv;
-	
-	gtk_tree_model_get(model, iter, 0, &rv, -1);
-	GtkTreeIter iter1 = *iter;
-	
-	GitgRevision *next_revision = NULL;
+	GitgRepository *repository = GITG_REPOSITORY(model);
 	
-	if (gtk_tree_model_iter_next(model, &iter1))
-		gtk_tree_model_get(model, &iter1, 0, &next_revision, -1);
-	
-	GSList *labels = gitg_repository_get_refs_for_hash(GITG_REPOSITORY(model), gitg_revision_get_hash(rv));
-
-	g_object_set(renderer, "revision", rv, "next_revision", next_revision, "labels", labels, NULL);
-
-	gitg_revision_unref(next_revision);
-	gitg_revision_unref(rv);
+	gitg_cell_renderer_path_set_row(renderer, repository, gitg_repository_get_row(repository, iter));
 }
 
 static gboolean
@@ -605,6 +762,7 @@ load_repository(GitgWindow *window, gchar const *path, gint argc, gchar const **
 	{
 		gtk_tree_view_set_model(window->priv->tree_view, NULL);
 		g_signal_handlers_disconnect_by_func(window->priv->repository, G_CALLBACK(on_repository_load), window);
+		g_signal_handlers_disconnect_by_func(window->priv->repository, G_CALLBACK(on_search_updated), window);
 
 		g_object_unref(window->priv->repository);
 		window->priv->repository = NULL;
@@ -637,6 +795,8 @@ load_repository(GitgWindow *window, gchar const *path, gint argc, gchar const **
 		}
 
 		g_signal_connect(window->priv->repository, "load", G_CALLBACK(on_repository_load), window);
+		g_signal_connect(window->priv->repository, "search-updated", G_CALLBACK(on_search_updated), window);
+		update_search(window);
 		clear_branches_combo(window, FALSE);
 		gitg_repository_load(window->priv->repository, argc, ar, NULL);
 		
@@ -768,6 +928,12 @@ on_view_refresh(GtkAction *action, GitgWindow *window)
 	}
 }
 
+void
+on_view_side_by_side(GtkToggleAction *action, GitgWindow *window)
+{
+	gitg_revision_view_set_side_by_side(window->priv->revision_view, gtk_toggle_action_get_active(action));
+}
+
 void
 on_window_set_focus(GitgWindow *window, GtkWidget *widget)
 {
@@ -843,7 +1009,7 @@ on_help_about(GtkAction *action, GitgWindow *window)
 }
 
 static gboolean
-find_lane_boundary(GitgWindow *window, GtkTreePath *path, gint cell_x, gchar const **hash)
+find_lane_boundary(GitgWindow *window, GtkTreePath *path, gint cell_x, Hash hash)
 {
 	GtkTreeModel *model = GTK_TREE_MODEL(window->priv->repository);
 	GtkTreeIter iter;
@@ -857,14 +1023,14 @@ find_lane_boundary(GitgWindow *window, GtkTreePath *path, gint cell_x, gchar con
 	g_object_get(window->priv->renderer_path, "lane-width", &width, NULL);
 	guint laneidx = cell_x / width;
 	
-	GSList *lanes = gitg_revision_get_lanes(revision);
-	GitgLane *lane = (GitgLane *)g_slist_nth_data(lanes, laneidx);
+	GitgLane lane;
 	gboolean ret;
 
-	if (lane && GITG_IS_LANE_BOUNDARY(lane))
+	if (gitg_lane_row_nth(gitg_revision_get_lanes(revision), laneidx, &lane) && GITG_IS_LANE_BOUNDARY(&lane))
 	{
+		/* the lane arena can be freed when its page is dropped */
 		if (hash)
-			*hash = ((GitgLaneBoundary *)lane)->hash;
+			memcpy(hash, lane.hash, sizeof(Hash));
 
 		ret = TRUE;
 	}
@@ -878,7 +1044,7 @@ find_lane_boundary(GitgWindow *window, GtkTreePath *path, gint cell_x, gchar con
 }
 
 static gboolean
-is_boundary_from_event(GitgWindow *window, GdkEventAny *event, gint x, gint y, gchar const **hash)
+is_boundary_from_event(GitgWindow *window, GdkEventAny *event, gint x, gint y, Hash hash)
 {
 	GtkTreePath *path;
 	GtkTreeViewColumn *column;
@@ -924,9 +1090,9 @@ on_tree_view_button_release(GtkTreeView *treeview, GdkEventButton *event, GitgWi
 	if (event->button != 1)
 		return FALSE;
 
-	gchar const *hash;
+	Hash hash;
 	
-	if (!is_boundary_from_event(window, (GdkEventAny *)event, event->x, event->y, &hash))
+	if (!is_boundary_from_event(window, (GdkEventAny *)event, event->x, event->y, hash))
 		return FALSE;
 	
 	goto_hash(window, hash);
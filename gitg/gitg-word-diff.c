@@ -0,0 +1,391 @@
+#include "gitg-word-diff.h"
+#include <string.h>
+
+/* Word diffs pair the removed and added lines of a change and diff every
+   pair as a sequence of tokens: runs of word characters, runs of white
+   space and single other characters. Tokens in common at the start and end
+   are trimmed first, the rest is diffed with the greedy algorithm of Myers,
+   which gives up on lines that have little in common. Blocks of line pairs
+   are diffed on a worker thread and picked up from the main thread */
+
+#define MAX_TOKENS 1000
+#define MAX_EDITS 256
+
+typedef struct
+{
+	guint start;
+	guint end;
+	guint hash;
+} Token;
+
+struct _GitgWordDiff
+{
+	GThread *thread;
+	GAsyncQueue *queue;
+	GMutex *mutex;
+
+	GitgWordDiffFunc func;
+	gpointer userdata;
+
+	/* blocks pushed before it changed are dropped */
+	volatile gint generation;
+
+	/* protected by mutex */
+	GQueue *done;
+	guint idle_id;
+};
+
+static GitgWordDiffBlock stop_block;
+
+static gboolean
+is_word_char(gunichar c)
+{
+	return c == '_' || g_unichar_isalnum(c);
+}
+
+static GArray *
+tokenize(gchar const *text)
+{
+	GArray *tokens = g_array_new(FALSE, FALSE, sizeof(Token));
+	gchar const *ptr = text;
+
+	while (*ptr)
+	{
+		gunichar c = g_utf8_get_char(ptr);
+		gchar const *next = g_utf8_next_char(ptr);
+
+		if (is_word_char(c))
+		{
+			while (*next && is_word_char(g_utf8_get_char(next)))
+				next = g_utf8_next_char(next);
+		}
+		else if (g_unichar_isspace(c))
+		{
+			while (*next && g_unichar_isspace(g_utf8_get_char(next)))
+				next = g_utf8_next_char(next);
+		}
+
+		Token token = {ptr - text, next - text, 2166136261u};
+		gchar const *p;
+
+		for (p = ptr; p < next; ++p)
+			token.hash = (token.hash ^ (guchar)*p) * 16777619u;
+
+		g_array_append_val(tokens, token);
+		ptr = next;
+	}
+
+	return tokens;
+}
+
+static gboolean
+token_equal(gchar const *a, Token const *ta, gchar const *b, Token const *tb)
+{
+	return ta->hash == tb->hash &&
+	       ta->end - ta->start == tb->end - tb->start &&
+	       memcmp(a + ta->start, b + tb->start, ta->end - ta->start) == 0;
+}
+
+/* Marks the tokens of a that are deleted and those of b that are inserted,
+   returns FALSE when more than MAX_EDITS edits are needed */
+static gboolean
+myers(gchar const *ta, Token const *a, gint n, gchar const *tb, Token const *b, gint m, gboolean *deleted, gboolean *inserted)
+{
+	gint limit = MIN(n + m, MAX_EDITS);
+	gint offset = limit + 1;
+	gint size = 2 * limit + 3;
+	gint *v = g_new0(gint, size);
+	gint *trace = g_new(gint, (limit + 1) * size);
+	gint d;
+	gint k;
+	gint x = 0;
+	gint y = 0;
+	gboolean found = FALSE;
+
+	for (d = 0; d <= limit && !found; ++d)
+	{
+		/* the furthest reaching paths before this round, to backtrack */
+		memcpy(trace + d * size, v, size * sizeof(gint));
+
+		for (k = -d; k <= d; k += 2)
+		{
+			if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+				x = v[offset + k + 1];
+			else
+				x = v[offset + k - 1] + 1;
+
+			y = x - k;
+
+			while (x < n && y < m && token_equal(ta, &a[x], tb, &b[y]))
+			{
+				++x;
+				++y;
+			}
+
+			v[offset + k] = x;
+
+			if (x >= n && y >= m)
+			{
+				found = TRUE;
+				break;
+			}
+		}
+	}
+
+	if (found)
+	{
+		x = n;
+		y = m;
+
+		for (d = d - 1; d > 0; --d)
+		{
+			gint *prev = trace + d * size;
+			gint prev_k;
+
+			k = x - y;
+
+			if (k == -d || (k != d && prev[offset + k - 1] < prev[offset + k + 1]))
+				prev_k = k + 1;
+			else
+				prev_k = k - 1;
+
+			gint prev_x = prev[offset + prev_k];
+			gint prev_y = prev_x - prev_k;
+
+			while (x > prev_x && y > prev_y)
+			{
+				--x;
+				--y;
+			}
+
+			if (x == prev_x)
+				inserted[prev_y] = TRUE;
+			else
+				deleted[prev_x] = TRUE;
+
+			x = prev_x;
+			y = prev_y;
+		}
+	}
+
+	g_free(v);
+	g_free(trace);
+
+	return found;
+}
+
+static void
+add_ranges(Token const *tokens, gboolean const *marked, gint num, guint line, gboolean added, GArray *ranges)
+{
+	gint i = 0;
+
+	while (i < num)
+	{
+		if (!marked[i])
+		{
+			++i;
+			continue;
+		}
+
+		GitgWordDiffRange range = {line, tokens[i].start, 0, added};
+
+		while (i < num && marked[i])
+			++i;
+
+		range.end = tokens[i - 1].end;
+		g_array_append_val(ranges, range);
+	}
+}
+
+/* Appends the changed byte ranges of a pair of lines to ranges, nothing is
+   added for lines that have too little in common */
+void
+gitg_word_diff_lines(gchar const *removed, gchar const *added, guint line, GArray *ranges)
+{
+	GArray *a = tokenize(removed);
+	GArray *b = tokenize(added);
+	Token *ta = (Token *)a->data;
+	Token *tb = (Token *)b->data;
+	gint n = a->len;
+	gint m = b->len;
+	gint prefix = 0;
+	gint suffix = 0;
+
+	if (n > MAX_TOKENS || m > MAX_TOKENS)
+		goto out;
+
+	while (prefix < n && prefix < m && token_equal(removed, &ta[prefix], added, &tb[prefix]))
+		++prefix;
+
+	while (suffix < n - prefix && suffix < m - prefix &&
+	       token_equal(removed, &ta[n - suffix - 1], added, &tb[m - suffix - 1]))
+		++suffix;
+
+	gint num_a = n - prefix - suffix;
+	gint num_b = m - prefix - suffix;
+	gboolean *deleted = g_new0(gboolean, num_a + 1);
+	gboolean *inserted = g_new0(gboolean, num_b + 1);
+
+	if (myers(removed, ta + prefix, num_a, added, tb + prefix, num_b, deleted, inserted))
+	{
+		gint i;
+		gint changed = 0;
+
+		for (i = 0; i < num_a; ++i)
+			changed += deleted[i];
+
+		/* lines that were rewritten rather than edited are not marked */
+		if ((n - changed) * 3 >= MAX(n, m))
+		{
+			add_ranges(ta + prefix, deleted, num_a, line, FALSE, ranges);
+			add_ranges(tb + prefix, inserted, num_b, line, TRUE, ranges);
+		}
+	}
+
+	g_free(deleted);
+	g_free(inserted);
+
+out:
+	g_array_free(a, TRUE);
+	g_array_free(b, TRUE);
+}
+
+GitgWordDiffBlock *
+gitg_word_diff_block_new(guint num)
+{
+	GitgWordDiffBlock *block = g_slice_new0(GitgWordDiffBlock);
+
+	block->removed = g_new0(gchar *, num + 1);
+	block->added = g_new0(gchar *, num + 1);
+	block->num = num;
+	block->ranges = g_array_new(FALSE, FALSE, sizeof(GitgWordDiffRange));
+
+	return block;
+}
+
+void
+gitg_word_diff_block_free(GitgWordDiffBlock *block)
+{
+	g_strfreev(block->removed);
+	g_strfreev(block->added);
+	g_array_free(block->ranges, TRUE);
+
+	g_slice_free(GitgWordDiffBlock, block);
+}
+
+static gboolean
+on_idle_notify(GitgWordDiff *diff)
+{
+	g_mutex_lock(diff->mutex);
+	diff->idle_id = 0;
+	g_mutex_unlock(diff->mutex);
+
+	diff->func(diff, diff->userdata);
+	return FALSE;
+}
+
+static gpointer
+worker(GitgWordDiff *diff)
+{
+	GitgWordDiffBlock *block;
+	guint i;
+
+	while ((block = (GitgWordDiffBlock *)g_async_queue_pop(diff->queue)) != &stop_block)
+	{
+		for (i = 0; i < block->num && block->generation == (guint)g_atomic_int_get(&diff->generation); ++i)
+			gitg_word_diff_lines(block->removed[i], block->added[i], i, block->ranges);
+
+		g_mutex_lock(diff->mutex);
+
+		g_queue_push_tail(diff->done, block);
+
+		if (diff->func && !diff->idle_id)
+			diff->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc)on_idle_notify, diff, NULL);
+
+		g_mutex_unlock(diff->mutex);
+	}
+
+	return NULL;
+}
+
+GitgWordDiff *
+gitg_word_diff_new(GitgWordDiffFunc func, gpointer userdata)
+{
+	GitgWordDiff *diff = g_slice_new0(GitgWordDiff);
+
+	diff->func = func;
+	diff->userdata = userdata;
+	diff->done = g_queue_new();
+
+	diff->mutex = g_mutex_new();
+	diff->queue = g_async_queue_new();
+	diff->thread = g_thread_create((GThreadFunc)worker, diff, TRUE, NULL);
+
+	return diff;
+}
+
+void
+gitg_word_diff_free(GitgWordDiff *diff)
+{
+	GitgWordDiffBlock *block;
+
+	if (!diff)
+		return;
+
+	g_atomic_int_inc(&diff->generation);
+	g_async_queue_push(diff->queue, &stop_block);
+	g_thread_join(diff->thread);
+
+	if (diff->idle_id)
+		g_source_remove(diff->idle_id);
+
+	while ((block = (GitgWordDiffBlock *)g_async_queue_try_pop(diff->queue)))
+		gitg_word_diff_block_free(block);
+
+	while ((block = (GitgWordDiffBlock *)g_queue_pop_head(diff->done)))
+		gitg_word_diff_block_free(block);
+
+	g_async_queue_unref(diff->queue);
+	g_mutex_free(diff->mutex);
+	g_queue_free(diff->done);
+
+	g_slice_free(GitgWordDiff, diff);
+}
+
+void
+gitg_word_diff_push(GitgWordDiff *diff, GitgWordDiffBlock *block)
+{
+	block->generation = g_atomic_int_get(&diff->generation);
+	g_async_queue_push(diff->queue, block);
+}
+
+/* The next diffed block, or NULL. Blocks pushed before the last cancel are
+   freed */
+GitgWordDiffBlock *
+gitg_word_diff_pop(GitgWordDiff *diff)
+{
+	GitgWordDiffBlock *block;
+
+	g_mutex_lock(diff->mutex);
+
+	while ((block = (GitgWordDiffBlock *)g_queue_pop_head(diff->done)))
+	{
+		if (block->generation == (guint)g_atomic_int_get(&diff->generation))
+			break;
+
+		gitg_word_diff_block_free(block);
+	}
+
+	g_mutex_unlock(diff->mutex);
+
+	return block;
+}
+
+void
+gitg_word_diff_cancel(GitgWordDiff *diff)
+{
+	if (!diff)
+		return;
+
+	g_atomic_int_inc(&diff->generation);
+}
@@ -0,0 +1,48 @@
+#ifndef __GITG_WORD_DIFF_H__
+#define __GITG_WORD_DIFF_H__
+
+#include <glib.h>
+
+typedef struct
+{
+	guint line;		/* index of the line pair in the block */
+	guint start;	/* byte range of the changed text in the line */
+	guint end;
+	gboolean added;
+} GitgWordDiffRange;
+
+typedef struct
+{
+	/* identify the block for the caller */
+	guint id;
+	guint index;
+
+	/* pairs of removed and added lines, owned by the block */
+	gchar **removed;
+	gchar **added;
+	guint num;
+
+	/* filled in by the worker */
+	GArray *ranges;
+
+	guint generation;
+} GitgWordDiffBlock;
+
+typedef struct _GitgWordDiff GitgWordDiff;
+
+/* Called from the main loop when blocks were diffed */
+typedef void (*GitgWordDiffFunc)(GitgWordDiff *diff, gpointer userdata);
+
+GitgWordDiffBlock *gitg_word_diff_block_new(guint num);
+void gitg_word_diff_block_free(GitgWordDiffBlock *block);
+
+void gitg_word_diff_lines(gchar const *removed, gchar const *added, guint line, GArray *ranges);
+
+GitgWordDiff *gitg_word_diff_new(GitgWordDiffFunc func, gpointer userdata);
+void gitg_word_diff_free(GitgWordDiff *diff);
+
+void gitg_word_diff_push(GitgWordDiff *diff, GitgWordDiffBlock *block);
+GitgWordDiffBlock *gitg_word_diff_pop(GitgWordDiff *diff);
+void gitg_word_diff_cancel(GitgWordDiff *diff);
+
+#endif /* __GITG_WORD_DIFF_H__ */